@@ -1,9 +1,9 @@
 #include "wordcount.h"
 #include <ctype.h>
 
-int count_words_chunk(const char *buf, ssize_t n, int *prev_in_word)
+uint64_t count_words_chunk(const char *buf, ssize_t n, int *prev_in_word)
 {
-    int count = 0;
+    uint64_t count = 0;
     int in_word = *prev_in_word;
 
     for (ssize_t i = 0; i < n; i++)
@@ -0,0 +1,542 @@
+/*
+ * bench.c: pwcbench, the benchmark harness for pwordcount ("make bench")
+ *
+ * Two suites, one row of results per configuration:
+ *
+ *   kernel  count_words_in_buffer() with every kernel this CPU supports
+ *           (scalar, sse2, avx2, avx512bw), plus the UTF-8 decoder and a
+ *           full wc_summarize(WC_ALL) pass, over synthetic buffers of
+ *           several sizes and word densities (share of whitespace bytes).
+ *   e2e     ./pwordcount run end to end on a generated file with each
+ *           transport (copy, splice, mmap, shm) and --threads.
+ *
+ * Every configuration gets --warmup untimed runs, then --reps timed runs.
+ * Reported per row: mean GB/s with a 95% confidence interval (Student's
+ * t), TSC cycles per byte (x86 only), and for e2e the number of system
+ * calls per GB, counted in one extra untimed run under ptrace (following
+ * Process 2 and the threads). Where ptrace is not allowed (some
+ * containers) that column is left empty.
+ *
+ * Output is CSV (default) or JSON (--format=json), so runs of two
+ * releases can be diffed or plotted.
+ */
+
+#define _GNU_SOURCE /* PTRACE_O_* */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "wordcount.h"
+#include "ioutil.h"
+
+#define MAX_REPS 1000
+
+/* Bytes scanned per timed kernel run: small buffers are scanned repeatedly */
+#define KERNEL_BYTES_PER_REP (64u * 1024 * 1024)
+
+static const size_t kernel_sizes[] = { 4096, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+static const double densities[] = { 0.05, 0.2, 0.5 };
+static const char *const kernels[] = { "scalar", "sse2", "avx2", "avx512bw" };
+
+struct bench_options
+{
+    int reps;
+    int warmup;
+    int json;
+    int quick;          /* --quick: small sizes and few reps, a smoke test */
+    const char *binary; /* pwordcount to run end to end */
+    size_t e2e_size;
+    int kernel_suite;
+    int e2e_suite;
+};
+
+struct row
+{
+    const char *suite;
+    const char *name;
+    size_t bytes;
+    double density;
+    int reps;
+    double gbps_mean;
+    double gbps_ci95;
+    double cycles_per_byte; /* NAN: no TSC */
+    double syscalls_per_gb; /* NAN: not measured */
+};
+
+static int rows_printed;
+
+/* ---------- measuring ---------- */
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t cycles(void)
+{
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Two-sided 95% Student's t for n-1 degrees of freedom */
+static double t95(int n)
+{
+    static const double t[] = { 0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    int df = n - 1;
+    if (df < 1)
+        return NAN;
+    return df <= 30 ? t[df] : 1.960;
+}
+
+/* Mean and 95% CI half-width of the per-run GB/s values */
+static void summarize(struct row *r, const double *gbps, int n)
+{
+    double sum = 0, sq = 0;
+    for (int i = 0; i < n; i++)
+        sum += gbps[i];
+    double mean = sum / n;
+    for (int i = 0; i < n; i++)
+        sq += (gbps[i] - mean) * (gbps[i] - mean);
+    r->reps = n;
+    r->gbps_mean = mean;
+    r->gbps_ci95 = n > 1 ? t95(n) * sqrt(sq / (n - 1)) / sqrt((double)n) : NAN;
+}
+
+/* ---------- output ---------- */
+
+static void print_number(const char *fmt, double v, int json)
+{
+    if (isnan(v))
+        printf("%s", json ? "null" : "");
+    else
+        printf(fmt, v);
+}
+
+static void print_row(const struct bench_options *bo, const struct row *r)
+{
+    if (bo->json)
+    {
+        printf("%s\n  {\"suite\": \"%s\", \"name\": \"%s\", \"bytes\": %zu, \"density\": %.2f, \"reps\": %d, "
+               "\"gbps\": ", rows_printed ? "," : "", r->suite, r->name, r->bytes, r->density, r->reps);
+        print_number("%.4f", r->gbps_mean, 1);
+        printf(", \"gbps_ci95\": ");
+        print_number("%.4f", r->gbps_ci95, 1);
+        printf(", \"cycles_per_byte\": ");
+        print_number("%.4f", r->cycles_per_byte, 1);
+        printf(", \"syscalls_per_gb\": ");
+        print_number("%.1f", r->syscalls_per_gb, 1);
+        printf("}");
+    }
+    else
+    {
+        printf("%s,%s,%zu,%.2f,%d,", r->suite, r->name, r->bytes, r->density, r->reps);
+        print_number("%.4f", r->gbps_mean, 0);
+        printf(",");
+        print_number("%.4f", r->gbps_ci95, 0);
+        printf(",");
+        print_number("%.4f", r->cycles_per_byte, 0);
+        printf(",");
+        print_number("%.1f", r->syscalls_per_gb, 0);
+        printf("\n");
+    }
+    rows_printed++;
+}
+
+/* ---------- synthetic input ---------- */
+
+static uint64_t xorshift64(uint64_t *s)
+{
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+/* Letters, with a `density` share of whitespace bytes (mostly spaces, some '\n' and '\t') */
+static void fill_text(unsigned char *buf, size_t n, double density, uint64_t *seed)
+{
+    uint64_t threshold = (uint64_t)(density * 65536.0);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t r = xorshift64(seed);
+        if ((r & 0xffff) < threshold)
+        {
+            unsigned k = (unsigned)(r >> 16) % 16;
+            buf[i] = k == 0 ? '\n' : k == 1 ? '\t' : ' ';
+        }
+        else
+        {
+            buf[i] = (unsigned char)('a' + (r >> 16) % 26);
+        }
+    }
+}
+
+/* ---------- kernel suite ---------- */
+
+enum kernel_kind
+{
+    KIND_WORDS,     /* count_words_in_buffer() */
+    KIND_UTF8,      /* count_words_utf8() */
+    KIND_SUMMARIZE  /* wc_summarize(WC_ALL) */
+};
+
+static volatile uint64_t sink; /* keeps the compiler from dropping the work */
+
+static void run_kernel_once(enum kernel_kind kind, const unsigned char *buf, size_t n, size_t rounds)
+{
+    for (size_t i = 0; i < rounds; i++)
+    {
+        if (kind == KIND_WORDS)
+        {
+            int prev = 0;
+            sink += count_words_in_buffer(buf, n, &prev);
+        }
+        else if (kind == KIND_UTF8)
+        {
+            struct wc_utf8_state st;
+            memset(&st, 0, sizeof(st));
+            sink += count_words_utf8(buf, n, &st) + count_words_utf8_finish(&st);
+        }
+        else
+        {
+            struct wc_summary s = wc_summarize(buf, n, WC_ALL);
+            sink += s.words + s.lines + s.chars + s.max_line;
+        }
+    }
+}
+
+static void bench_kernel(const struct bench_options *bo, const char *name, enum kernel_kind kind,
+                         const unsigned char *buf, size_t n, double density)
+{
+    size_t rounds = KERNEL_BYTES_PER_REP / n;
+    if (bo->quick)
+        rounds = rounds / 16 ? rounds / 16 : 1;
+
+    for (int i = 0; i < bo->warmup; i++)
+        run_kernel_once(kind, buf, n, rounds);
+
+    double gbps[MAX_REPS];
+    uint64_t total_cycles = 0;
+    for (int i = 0; i < bo->reps; i++)
+    {
+        double t0 = now_sec();
+        uint64_t c0 = cycles();
+        run_kernel_once(kind, buf, n, rounds);
+        total_cycles += cycles() - c0;
+        double t = now_sec() - t0;
+        gbps[i] = (double)n * (double)rounds / t / 1e9;
+    }
+
+    struct row r = { "kernel", name, n, density, 0, 0, 0, NAN, NAN };
+    summarize(&r, gbps, bo->reps);
+    if (HAVE_TSC)
+        r.cycles_per_byte = (double)total_cycles / ((double)n * (double)rounds * bo->reps);
+    print_row(bo, &r);
+}
+
+static void kernel_suite(const struct bench_options *bo)
+{
+    size_t max = bo->quick ? 64 * 1024 : kernel_sizes[sizeof(kernel_sizes) / sizeof(kernel_sizes[0]) - 1];
+    unsigned char *buf = malloc(max);
+    if (!buf)
+        die_perror("malloc");
+
+    for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++)
+    {
+        uint64_t seed = 0x9e3779b97f4a7c15ull;
+        fill_text(buf, max, densities[d], &seed);
+
+        for (size_t s = 0; s < sizeof(kernel_sizes) / sizeof(kernel_sizes[0]) && kernel_sizes[s] <= max; s++)
+        {
+            size_t n = kernel_sizes[s];
+            for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+            {
+                if (wordcount_set_kernel(kernels[k]) < 0)
+                    continue; /* not supported by this CPU */
+                bench_kernel(bo, kernels[k], KIND_WORDS, buf, n, densities[d]);
+            }
+
+            /* The stateful decoder and the all-metrics pass use the best kernel */
+            wordcount_set_kernel("auto");
+            bench_kernel(bo, "utf8", KIND_UTF8, buf, n, densities[d]);
+            bench_kernel(bo, "summarize-all", KIND_SUMMARIZE, buf, n, densities[d]);
+        }
+    }
+    free(buf);
+}
+
+/* ---------- e2e suite ---------- */
+
+/* fork + exec pwordcount with its output thrown away. Returns the exit status, -1 on failure. */
+static int run_binary(const struct bench_options *bo, char *const argv[], int traced, uint64_t *syscalls)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        die_perror("fork");
+
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+        {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            close(null);
+        }
+        if (traced)
+        {
+            if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0)
+                _exit(126);
+            raise(SIGSTOP);
+        }
+        /* A cache hit or a daemon round trip would be measured instead of the transport */
+        unsetenv("PWORDCOUNT_CACHE");
+        unsetenv("PWORDCOUNT_SOCKET");
+        execv(bo->binary, argv);
+        _exit(127);
+    }
+
+    int status;
+    if (!traced)
+    {
+        if (waitpid(pid, &status, 0) < 0)
+            return -1;
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    /* Wait for the SIGSTOP, then trace every syscall of the tree until the tool exits */
+    if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+        return -1;
+    ptrace(PTRACE_SETOPTIONS, pid, NULL,
+           (void *)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+                          PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL));
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+    uint64_t stops = 0;
+    int exit_code = -1;
+    while (1)
+    {
+        pid_t who = waitpid(-1, &status, __WALL);
+        if (who < 0)
+            break; /* no traced process left */
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+        {
+            if (who == pid)
+                exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            continue;
+        }
+
+        int sig = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80))
+        {
+#ifdef PTRACE_GET_SYSCALL_INFO
+            struct __ptrace_syscall_info info;
+            if (ptrace(PTRACE_GET_SYSCALL_INFO, who, (void *)sizeof(info), &info) > 0)
+                stops += info.op == PTRACE_SYSCALL_INFO_ENTRY ? 2 : 0;
+            else
+                stops++;
+#else
+            stops++; /* entry and exit: halved below */
+#endif
+        }
+        else if (status >> 16 == 0 && WSTOPSIG(status) != SIGSTOP && WSTOPSIG(status) != SIGTRAP)
+        {
+            sig = WSTOPSIG(status); /* a real signal: deliver it */
+        }
+        ptrace(PTRACE_SYSCALL, who, NULL, (void *)(long)sig);
+    }
+
+    *syscalls = (stops + 1) / 2;
+    return exit_code;
+}
+
+static char *make_input_file(const struct bench_options *bo)
+{
+    const char *dir = getenv("TMPDIR");
+    char *path = malloc(strlen(dir ? dir : "/tmp") + 32);
+    if (!path)
+        die_perror("malloc");
+    sprintf(path, "%s/pwcbench.XXXXXX", dir ? dir : "/tmp");
+
+    int fd = mkstemp(path);
+    if (fd < 0)
+        die_perror("mkstemp");
+
+    size_t block = 1024 * 1024;
+    unsigned char *buf = malloc(block);
+    if (!buf)
+        die_perror("malloc");
+    uint64_t seed = 0x243f6a8885a308d3ull;
+    for (size_t done = 0; done < bo->e2e_size; done += block)
+    {
+        size_t n = bo->e2e_size - done < block ? bo->e2e_size - done : block;
+        fill_text(buf, n, 0.2, &seed);
+        write_all(fd, buf, n);
+    }
+    free(buf);
+    close(fd);
+    return path;
+}
+
+static void e2e_suite(const struct bench_options *bo)
+{
+    char *path = make_input_file(bo);
+
+    static const char *const names[] = { "copy", "splice", "mmap", "shm", "threads" };
+    static const char *const flags[] = { "--transport=copy", "--transport=splice", "--transport=mmap",
+                                         "--transport=shm", "--threads" };
+
+    for (size_t t = 0; t < sizeof(names) / sizeof(names[0]); t++)
+    {
+        char *argv[] = { (char *)bo->binary, (char *)flags[t], path, NULL };
+        uint64_t unused;
+        int failed = 0;
+
+        for (int i = 0; i < bo->warmup && !failed; i++)
+            failed = run_binary(bo, argv, 0, &unused) != 0;
+
+        double gbps[MAX_REPS];
+        uint64_t total_cycles = 0;
+        for (int i = 0; i < bo->reps && !failed; i++)
+        {
+            double t0 = now_sec();
+            uint64_t c0 = cycles();
+            failed = run_binary(bo, argv, 0, &unused) != 0;
+            total_cycles += cycles() - c0;
+            gbps[i] = (double)bo->e2e_size / (now_sec() - t0) / 1e9;
+        }
+        if (failed)
+        {
+            fprintf(stderr, "Warning: \"%s %s\" failed, skipping it.\n", bo->binary, flags[t]);
+            continue;
+        }
+
+        struct row r = { "e2e", names[t], bo->e2e_size, 0.2, 0, 0, 0, NAN, NAN };
+        summarize(&r, gbps, bo->reps);
+        if (HAVE_TSC)
+            r.cycles_per_byte = (double)total_cycles / ((double)bo->e2e_size * bo->reps);
+
+        uint64_t syscalls = 0;
+        if (run_binary(bo, argv, 1, &syscalls) == 0)
+            r.syscalls_per_gb = (double)syscalls / ((double)bo->e2e_size / 1e9);
+        print_row(bo, &r);
+    }
+
+    unlink(path);
+    free(path);
+}
+
+/* ---------- main ---------- */
+
+static void print_usage(void)
+{
+    printf("Usage: ./pwcbench [--reps=N] [--warmup=N] [--format=csv|json] [--quick]\n"
+           "                  [--suite=all|kernel|e2e] [--binary=PATH] [--e2e-size=SIZE]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_options bo = { 10, 2, 0, 0, "./pwordcount", 256u * 1024 * 1024, 1, 1 };
+    int reps_given = 0, size_given = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        char *end;
+        if (strncmp(arg, "--reps=", 7) == 0)
+        {
+            long n = strtol(arg + 7, &end, 10);
+            if (*end != '\0' || n < 1 || n > MAX_REPS)
+            {
+                fprintf(stderr, "Error: invalid --reps \"%s\" (1..%d).\n", arg + 7, MAX_REPS);
+                return EXIT_FAILURE;
+            }
+            bo.reps = (int)n;
+            reps_given = 1;
+        }
+        else if (strncmp(arg, "--warmup=", 9) == 0)
+        {
+            long n = strtol(arg + 9, &end, 10);
+            if (*end != '\0' || n < 0 || n > MAX_REPS)
+            {
+                fprintf(stderr, "Error: invalid --warmup \"%s\".\n", arg + 9);
+                return EXIT_FAILURE;
+            }
+            bo.warmup = (int)n;
+        }
+        else if (strcmp(arg, "--format=csv") == 0)
+            bo.json = 0;
+        else if (strcmp(arg, "--format=json") == 0)
+            bo.json = 1;
+        else if (strcmp(arg, "--quick") == 0)
+            bo.quick = 1;
+        else if (strcmp(arg, "--suite=all") == 0)
+            bo.kernel_suite = bo.e2e_suite = 1;
+        else if (strcmp(arg, "--suite=kernel") == 0)
+            bo.kernel_suite = 1, bo.e2e_suite = 0;
+        else if (strcmp(arg, "--suite=e2e") == 0)
+            bo.kernel_suite = 0, bo.e2e_suite = 1;
+        else if (strncmp(arg, "--binary=", 9) == 0 && arg[9] != '\0')
+            bo.binary = arg + 9;
+        else if (strncmp(arg, "--e2e-size=", 11) == 0)
+        {
+            if (parse_size(arg + 11, &bo.e2e_size) < 0 || bo.e2e_size == 0)
+            {
+                fprintf(stderr, "Error: invalid --e2e-size \"%s\".\n", arg + 11);
+                return EXIT_FAILURE;
+            }
+            size_given = 1;
+        }
+        else
+        {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (bo.quick)
+    {
+        if (!reps_given)
+            bo.reps = 3;
+        if (!size_given)
+            bo.e2e_size = 16u * 1024 * 1024;
+    }
+
+    if (bo.json)
+        printf("[");
+    else
+        printf("suite,name,bytes,density,reps,gbps,gbps_ci95,cycles_per_byte,syscalls_per_gb\n");
+
+    if (bo.kernel_suite)
+        kernel_suite(&bo);
+    if (bo.e2e_suite)
+        e2e_suite(&bo);
+
+    if (bo.json)
+        printf("\n]\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,319 @@
+/*
+ * cache.c: the --cache=FILE result cache (see cache.h)
+ *
+ * File layout (host byte order, like every other pwordcount format):
+ *
+ *   struct cache_header   magic "PWCC", version, slot count, CLOCK hands
+ *   struct cache_slot     x CACHE_SLOTS, grouped in sets of CACHE_WAYS
+ *
+ * A file with the wrong size or header (an older version, garbage, a
+ * truncated file) is reset to an empty table instead of being trusted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+#define CACHE_MAGIC 0x43435750u /* "PWCC" read as little-endian bytes */
+#define CACHE_VERSION 2
+
+#define CACHE_SETS (CACHE_SLOTS / CACHE_WAYS)
+
+/*
+ * Coarsest timestamp granularity we expect (FAT has 2 s; most file systems
+ * tick once per jiffy). A file changed less than this long ago may change
+ * again without its mtime or ctime moving, so it is not stored.
+ */
+#define CACHE_RACY_NS 2000000000ull
+
+struct cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t ways;
+    uint32_t hands[CACHE_SETS]; /* next way the CLOCK sweep looks at */
+};
+
+struct cache_slot
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime_ns;
+    uint64_t ctime_ns;   /* also moves on utimensat(), so a restored mtime is caught */
+    uint32_t metrics;    /* WC_* counted (WC_UTF8 included); 0 = empty slot */
+    uint32_t referenced; /* CLOCK bit, set by hits */
+    struct wc_counts counts;
+    uint64_t check;      /* slot_check() of everything above except referenced */
+};
+
+static struct cache_header *header_of(const struct result_cache *c)
+{
+    return (struct cache_header *)((char *)c->slots - sizeof(struct cache_header));
+}
+
+/* splitmix64 finalizer: cheap, and every input bit reaches every output bit */
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t slot_check(const struct cache_slot *s)
+{
+    uint64_t h = mix64(s->dev ^ 0x9e3779b97f4a7c15ull);
+    h = mix64(h ^ s->ino);
+    h = mix64(h ^ s->size);
+    h = mix64(h ^ s->mtime_ns);
+    h = mix64(h ^ s->ctime_ns);
+    h = mix64(h ^ s->metrics);
+    h = mix64(h ^ s->counts.lines);
+    h = mix64(h ^ s->counts.words);
+    h = mix64(h ^ s->counts.bytes);
+    h = mix64(h ^ s->counts.chars);
+    h = mix64(h ^ s->counts.max_line);
+    return h;
+}
+
+/* The set depends on the inode only, so a file's stale entry is found and replaced */
+static struct cache_slot *set_of(const struct result_cache *c, uint64_t *set_index)
+{
+    *set_index = mix64(c->dev * 31 + c->ino) % CACHE_SETS;
+    return c->slots + *set_index * CACHE_WAYS;
+}
+
+static int slot_valid(const struct cache_slot *s)
+{
+    return s->metrics != 0 && s->check == slot_check(s);
+}
+
+static int same_inode(const struct cache_slot *s, const struct result_cache *c)
+{
+    return s->dev == c->dev && s->ino == c->ino && (s->metrics & WC_UTF8) == (c->metrics & WC_UTF8);
+}
+
+static int same_version(const struct cache_slot *s, const struct result_cache *c)
+{
+    return same_inode(s, c) && s->size == c->size && s->mtime_ns == c->mtime_ns &&
+           s->ctime_ns == c->ctime_ns;
+}
+
+static int lock(int fd, int op)
+{
+    while (flock(fd, op) < 0)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+    return 0;
+}
+
+static uint64_t to_ns(struct timespec ts)
+{
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int stat_key(const char *filename, uint64_t *dev, uint64_t *ino, uint64_t *size, uint64_t *mtime_ns,
+                    uint64_t *ctime_ns)
+{
+    struct stat st;
+    if (stat(filename, &st) < 0 || !S_ISREG(st.st_mode))
+        return -1;
+    *dev = (uint64_t)st.st_dev;
+    *ino = (uint64_t)st.st_ino;
+    *size = (uint64_t)st.st_size;
+    *mtime_ns = to_ns(st.st_mtim);
+    *ctime_ns = to_ns(st.st_ctim);
+    return 0;
+}
+
+int result_cache_open(struct result_cache *c, const char *path)
+{
+    memset(c, 0, sizeof(*c));
+    c->map_size = sizeof(struct cache_header) + CACHE_SLOTS * sizeof(struct cache_slot);
+
+    c->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (c->fd < 0)
+        return -1;
+
+    /* Exclusive while we check (and maybe reset) the header */
+    if (lock(c->fd, LOCK_EX) < 0)
+        goto fail;
+
+    struct stat st;
+    if (fstat(c->fd, &st) < 0)
+        goto fail;
+
+    int fresh = (size_t)st.st_size != c->map_size;
+    if (fresh && ftruncate(c->fd, (off_t)c->map_size) < 0)
+        goto fail;
+
+    void *p = mmap(NULL, c->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (p == MAP_FAILED)
+        goto fail;
+
+    struct cache_header *h = p;
+    c->slots = (struct cache_slot *)(h + 1);
+
+    if (fresh || h->magic != CACHE_MAGIC || h->version != CACHE_VERSION ||
+        h->slots != CACHE_SLOTS || h->ways != CACHE_WAYS)
+    {
+        memset(p, 0, c->map_size);
+        h->magic = CACHE_MAGIC;
+        h->version = CACHE_VERSION;
+        h->slots = CACHE_SLOTS;
+        h->ways = CACHE_WAYS;
+    }
+
+    lock(c->fd, LOCK_UN);
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        close(c->fd);
+        c->fd = -1;
+        errno = saved;
+    }
+    return -1;
+}
+
+void result_cache_close(struct result_cache *c)
+{
+    if (c->slots)
+        munmap(header_of(c), c->map_size);
+    if (c->fd >= 0)
+        close(c->fd);
+    c->slots = NULL;
+    c->fd = -1;
+}
+
+int result_cache_lookup(struct result_cache *c, const char *filename, unsigned metrics, struct wc_counts *out)
+{
+    c->filename = filename;
+    c->metrics = metrics & (WC_ALL | WC_UTF8);
+    c->have_key = stat_key(filename, &c->dev, &c->ino, &c->size, &c->mtime_ns, &c->ctime_ns) == 0;
+    if (!c->have_key || lock(c->fd, LOCK_SH) < 0)
+        return 0;
+
+    uint64_t set_index;
+    struct cache_slot *set = set_of(c, &set_index);
+    int hit = 0;
+
+    for (int way = 0; way < CACHE_WAYS; way++)
+    {
+        struct cache_slot *s = &set[way];
+        if (slot_valid(s) && same_version(s, c) && (s->metrics & c->metrics) == c->metrics)
+        {
+            *out = s->counts;
+            /* Other readers may set it too; only the bit matters, so a plain atomic store is enough */
+            __atomic_store_n(&s->referenced, 1, __ATOMIC_RELAXED);
+            hit = 1;
+            break;
+        }
+    }
+
+    lock(c->fd, LOCK_UN);
+    return hit;
+}
+
+void result_cache_store(struct result_cache *c, const struct wc_counts *counts)
+{
+    if (!c || !c->have_key)
+        return;
+
+    /* Written to while we counted: these counts belong to no stable version */
+    uint64_t dev, ino, size, mtime_ns, ctime_ns;
+    if (stat_key(c->filename, &dev, &ino, &size, &mtime_ns, &ctime_ns) < 0 || dev != c->dev || ino != c->ino ||
+        size != c->size || mtime_ns != c->mtime_ns || ctime_ns != c->ctime_ns)
+        return;
+
+    /* Changed within one timestamp tick: a same-size rewrite could follow with the same key */
+    struct timespec now_ts;
+    clock_gettime(CLOCK_REALTIME, &now_ts);
+    uint64_t now = to_ns(now_ts);
+    if (mtime_ns + CACHE_RACY_NS > now || ctime_ns + CACHE_RACY_NS > now)
+        return;
+
+    if (lock(c->fd, LOCK_EX) < 0)
+        return;
+
+    uint64_t set_index;
+    struct cache_slot *set = set_of(c, &set_index);
+    struct cache_slot *victim = NULL;
+    struct cache_slot entry = { 0 };
+
+    /* 1. this file already has a slot: update it (and keep metrics counted earlier for the same version) */
+    for (int way = 0; way < CACHE_WAYS && !victim; way++)
+    {
+        struct cache_slot *s = &set[way];
+        if (slot_valid(s) && same_inode(s, c))
+        {
+            victim = s;
+            if (same_version(s, c))
+            {
+                entry.metrics = s->metrics;
+                entry.counts = s->counts;
+            }
+        }
+    }
+
+    /* 2. an empty (or torn) slot */
+    for (int way = 0; way < CACHE_WAYS && !victim; way++)
+    {
+        if (!slot_valid(&set[way]))
+            victim = &set[way];
+    }
+
+    /* 3. CLOCK: give referenced slots a second chance, evict the first one that had none */
+    if (!victim)
+    {
+        uint32_t *hand = &header_of(c)->hands[set_index];
+        while (!victim)
+        {
+            struct cache_slot *s = &set[*hand % CACHE_WAYS];
+            *hand = (*hand + 1) % CACHE_WAYS;
+            if (s->referenced)
+                s->referenced = 0;
+            else
+                victim = s;
+        }
+    }
+
+    entry.dev = c->dev;
+    entry.ino = c->ino;
+    entry.size = c->size;
+    entry.mtime_ns = c->mtime_ns;
+    entry.ctime_ns = c->ctime_ns;
+    entry.metrics |= c->metrics;
+    if (c->metrics & WC_LINES)
+        entry.counts.lines = counts->lines;
+    if (c->metrics & WC_WORDS)
+        entry.counts.words = counts->words;
+    if (c->metrics & WC_CHARS)
+        entry.counts.chars = counts->chars;
+    if (c->metrics & WC_MAX_LINE)
+        entry.counts.max_line = counts->max_line;
+    /* Bytes are always counted (wordcount.h) */
+    entry.counts.bytes = counts->bytes;
+    entry.metrics |= WC_BYTES;
+    entry.referenced = 1;
+    entry.check = slot_check(&entry);
+
+    *victim = entry;
+    lock(c->fd, LOCK_UN);
+}
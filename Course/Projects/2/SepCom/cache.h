@@ -0,0 +1,68 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wordcount.h"
+
+/*
+ * On-disk result cache for --cache=FILE (cache.c).
+ *
+ * A fixed-size file, mapped MAP_SHARED, holds a hash table
+ *
+ *   (dev, ino, size, mtime_ns, ctime_ns, --utf8) -> struct wc_counts + metric mask
+ *
+ * so an unchanged file is answered after a single stat(), without reading
+ * it. A write normally changes the size or the timestamps, which changes
+ * the key, so stale entries just age out. Timestamps only move once per
+ * file system tick, though: a same-size rewrite within one tick keeps the
+ * key. So a file modified in the last CACHE_RACY_NS (cache.c) is counted
+ * but not stored, and ctime is part of the key so that restoring the old
+ * mtime with touch or utimensat() is noticed too.
+ *
+ * The table is set-associative: an inode always hashes to the same set of
+ * CACHE_WAYS slots, and a full set evicts with the CLOCK algorithm (a slot
+ * whose "referenced" bit is clear goes first; hits set the bit). The file
+ * never grows beyond CACHE_SLOTS slots.
+ *
+ * Concurrent invocations share the file: lookups hold flock(LOCK_SH),
+ * stores hold flock(LOCK_EX). Every slot carries a checksum, so a process
+ * killed in the middle of a store leaves an empty slot, not wrong counts.
+ */
+#define CACHE_SLOTS 4096
+#define CACHE_WAYS 8
+
+struct cache_slot; /* the part inside the mapping, see cache.c */
+
+struct result_cache
+{
+    int fd;
+    struct cache_slot *slots;
+    size_t map_size;
+
+    /* The file being counted, from result_cache_lookup() */
+    const char *filename;
+    unsigned metrics;
+    int have_key;
+    uint64_t dev, ino, size, mtime_ns, ctime_ns;
+};
+
+/* Open (creating or resetting it if needed) and map the cache file. Returns 0, or -1 with errno set. */
+int result_cache_open(struct result_cache *c, const char *path);
+void result_cache_close(struct result_cache *c);
+
+/*
+ * Look up filename for the given WC_* metrics (WC_UTF8 included).
+ * Returns 1 and fills *out on a hit, 0 on a miss. Either way the key is
+ * remembered for result_cache_store().
+ */
+int result_cache_lookup(struct result_cache *c, const char *filename, unsigned metrics, struct wc_counts *out);
+
+/*
+ * Store the counts of the file from the last lookup. Nothing is stored if
+ * the file changed while it was being counted.
+ */
+void result_cache_store(struct result_cache *c, const struct wc_counts *counts);
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * checkpoint.c: save and resume the counting state of append-only files
+ * (see checkpoint.h)
+ *
+ * File format (host byte order; both ends are the same binary):
+ *   magic "PWCK", version, sizeof(struct wc_stream), then the fields of
+ *   struct checkpoint_file below.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "checkpoint.h"
+#include "freq.h"
+#include "ioutil.h"
+
+#define CHECKPOINT_MAGIC 0x4b435750u /* "PWCK" read as little-endian bytes */
+#define CHECKPOINT_VERSION 1
+
+struct checkpoint_file
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t stream_size; /* a rebuilt binary with another layout must not resume */
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t offset;
+    uint64_t block_hash;
+    uint32_t block_len;
+    uint32_t reserved;
+    struct wc_stream stream;
+};
+
+/* Hash of the `len` bytes of fd that end at `end`. Returns -1 if they cannot be read. */
+static int hash_block(int fd, uint64_t end, uint32_t len, uint64_t *hash)
+{
+    unsigned char buf[CHECKPOINT_BLOCK];
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t r = pread(fd, buf + got, len - got, (off_t)(end - len + got));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        got += (size_t)r;
+    }
+    *hash = freq_hash(buf, len);
+    return 0;
+}
+
+static int read_checkpoint(const char *path, struct checkpoint_file *f)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    size_t n = read_all(fd, f, sizeof(*f));
+    close(fd);
+
+    if (n != sizeof(*f) || f->magic != CHECKPOINT_MAGIC || f->version != CHECKPOINT_VERSION ||
+        f->stream_size != sizeof(struct wc_stream) || f->block_len > CHECKPOINT_BLOCK ||
+        f->stream.total.bytes != f->offset)
+        return -1;
+    return 0;
+}
+
+int checkpoint_load(struct checkpoint *cp, const char *path, const char *filename, unsigned metrics)
+{
+    memset(cp, 0, sizeof(*cp));
+    cp->path = path;
+    metrics &= WC_ALL | WC_UTF8;
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    cp->dev = (uint64_t)st.st_dev;
+    cp->ino = (uint64_t)st.st_ino;
+
+    struct checkpoint_file f;
+    int resume = 0;
+    if (read_checkpoint(path, &f) == 0 && (f.stream.metrics & WC_UTF8) == (metrics & WC_UTF8))
+    {
+        uint64_t hash = 0;
+        int same_data = f.dev == cp->dev && f.ino == cp->ino && f.offset <= (uint64_t)st.st_size &&
+                        (f.block_len == 0 || (hash_block(fd, f.offset, f.block_len, &hash) == 0 &&
+                                              hash == f.block_hash));
+
+        if (same_data && (f.stream.metrics & metrics) == metrics)
+        {
+            cp->offset = f.offset;
+            cp->block_hash = f.block_hash;
+            cp->block_len = f.block_len;
+            cp->stream = f.stream;
+            resume = 1;
+        }
+        else
+        {
+            /* Start over, but keep counting what the checkpoint had so -l and -w runs can alternate */
+            metrics |= f.stream.metrics;
+        }
+    }
+    close(fd);
+
+    if (!resume)
+        wc_stream_init(&cp->stream, metrics);
+    return resume;
+}
+
+int checkpoint_save(const struct checkpoint *cp, const char *filename, const struct wc_stream *state)
+{
+    struct checkpoint_file f;
+    memset(&f, 0, sizeof(f));
+    f.magic = CHECKPOINT_MAGIC;
+    f.version = CHECKPOINT_VERSION;
+    f.stream_size = sizeof(struct wc_stream);
+    f.dev = cp->dev;
+    f.ino = cp->ino;
+    f.offset = state->total.bytes;
+    f.stream = *state;
+
+    /* The block that ends where we stopped; it must still be there next time */
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    f.block_len = f.offset < CHECKPOINT_BLOCK ? (uint32_t)f.offset : CHECKPOINT_BLOCK;
+    int rc = f.block_len ? hash_block(fd, f.offset, f.block_len, &f.block_hash) : 0;
+    close(fd);
+    if (rc < 0)
+    {
+        errno = EIO;
+        return -1;
+    }
+
+    size_t len = strlen(cp->path);
+    char *tmp = malloc(len + 5);
+    if (!tmp)
+        die_perror("malloc");
+    memcpy(tmp, cp->path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        free(tmp);
+        return -1;
+    }
+    ssize_t w;
+    do
+        w = write(fd, &f, sizeof(f));
+    while (w < 0 && errno == EINTR);
+    if (w != (ssize_t)sizeof(f))
+    {
+        int saved = w < 0 ? errno : EIO; /* a short write sets no errno */
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        errno = saved;
+        return -1;
+    }
+    if (close(fd) < 0 || rename(tmp, cp->path) < 0)
+    {
+        int saved = errno;
+        unlink(tmp);
+        free(tmp);
+        errno = saved;
+        return -1;
+    }
+    free(tmp);
+    return 0;
+}
+
+void checkpoint_send_state(int fd, const struct wc_stream *state)
+{
+    write_all(fd, state, sizeof(*state));
+}
+
+int checkpoint_recv_state(int fd, struct wc_stream *state)
+{
+    return read_all(fd, state, sizeof(*state)) == sizeof(*state) ? 0 : -1;
+}
@@ -0,0 +1,59 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "wordcount.h"
+
+/*
+ * Incremental counting of append-only files (--checkpoint=FILE, checkpoint.c).
+ *
+ * struct wc_stream already carries everything needed to continue counting
+ * where the previous chunk stopped (the running summary, prev_in_word, a
+ * partial UTF-8 character). The checkpoint saves that state together with
+ * where it stopped in which file:
+ *
+ *   dev, ino     the file that was counted
+ *   offset       bytes counted so far (= stream.total.bytes)
+ *   block_hash   freq_hash() of the last CHECKPOINT_BLOCK bytes before offset
+ *
+ * On the next run Process 1 seeks to offset and only the new bytes cross
+ * pipe #1; Process 2 starts from the saved stream instead of an empty one
+ * and sends its (unfinished) stream back after the result, to be saved.
+ *
+ * A file that was replaced (other inode), truncated (smaller than offset)
+ * or rewritten (the last block hashes differently) is counted from 0.
+ */
+#define CHECKPOINT_BLOCK 4096
+
+struct checkpoint
+{
+    const char *path;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t offset;       /* where Process 1 starts reading */
+    uint64_t block_hash;
+    uint32_t block_len;
+    struct wc_stream stream; /* Process 2 starts from this state */
+};
+
+/*
+ * Load the checkpoint at path for filename. Returns 1 if counting can
+ * resume at cp->offset, 0 if it must start from 0 (no usable checkpoint;
+ * cp->stream is then a fresh stream), -1 if filename cannot be stat()ed.
+ * The stream counts at least `metrics`, plus any the checkpoint had.
+ */
+int checkpoint_load(struct checkpoint *cp, const char *path, const char *filename, unsigned metrics);
+
+/*
+ * Save the unfinished stream state received from Process 2 for filename.
+ * Written to a temporary file and renamed, so a crash never leaves a
+ * half-written checkpoint. Returns 0, or -1 with errno set.
+ */
+int checkpoint_save(const struct checkpoint *cp, const char *filename, const struct wc_stream *state);
+
+/* Process 2 -> Process 1 on pipe #2, after the result: the stream BEFORE wc_stream_finish() */
+void checkpoint_send_state(int fd, const struct wc_stream *state);
+int checkpoint_recv_state(int fd, struct wc_stream *state);
+
+#endif
@@ -0,0 +1,511 @@
+/*
+ * daemon.c: "--daemon=SOCKET" server and "--connect=SOCKET" client
+ *
+ * Forking a Process 2 and creating two pipes costs far more than counting
+ * a small file. In daemon mode the counting processes are started ONCE:
+ *
+ *   client --(Unix socket: request + file descriptor)--> counter process
+ *   client <--(reply + struct wc_result, as on pipe #2)-- counter process
+ *
+ * Process 1 preforks a pool of counters that all accept() on the same
+ * listening socket (the kernel hands each connection to one of them), and
+ * replaces any counter that dies. Every request carries an open file
+ * descriptor (SCM_RIGHTS), so the file is opened with the CLIENT's
+ * permissions; the daemon never opens a path for anyone. The socket is
+ * created mode 0600, so only the daemon's own user can connect at all.
+ *
+ * Clients: "--connect=SOCKET", or set PWORDCOUNT_SOCKET and keep calling
+ * "./pwordcount <file>": if the daemon answers, only the result lines are
+ * printed; if it does not, the file is counted locally as before.
+ */
+
+#define _GNU_SOURCE /* accept4() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "pwordcount.h"
+#include "wordcount.h"
+#include "ioutil.h"
+#include "result.h"
+#include "cache.h"
+
+#define DAEMON_MAGIC 0x51435750u /* "PWCQ" read as little-endian bytes */
+#define DAEMON_VERSION 2 /* 2: descriptor only, no path requests */
+
+/* Counters kept warm when no -j N is given */
+#define DAEMON_WORKERS 4
+
+/* Bytes counted at a time from a mapped file (as MMAP_SLICE in pwordcount.c) */
+#define DAEMON_SLICE (256 * 1024)
+
+/* Client -> daemon, always together with the descriptor of the file to count */
+struct daemon_request
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t unused;
+    uint32_t metrics; /* WC_* flags, WC_UTF8 included */
+    uint32_t reserved;
+};
+
+/* Daemon -> client. A struct wc_result (result.h) follows when error == 0. */
+struct daemon_reply
+{
+    uint32_t magic;
+    int32_t error; /* errno value from the daemon side */
+};
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+/* ---------- socket helpers (errors are returned, not fatal: one bad client must not kill a counter) ---------- */
+
+static int make_address(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int send_all(int sock, const void *buf, size_t n)
+{
+    const unsigned char *p = buf;
+    while (n > 0)
+    {
+        /* MSG_NOSIGNAL: a client that went away gives EPIPE, not SIGPIPE */
+        ssize_t w = send(sock, p, n, MSG_NOSIGNAL);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static int recv_all(int sock, void *buf, size_t n)
+{
+    unsigned char *p = buf;
+    while (n > 0)
+    {
+        ssize_t r = recv(sock, p, n, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+/*
+ * Receive the fixed request header together with an optional descriptor.
+ * Returns 0 (with *fd = -1 if none was passed), or -1 on EOF/error or a
+ * request carrying more than one descriptor.
+ */
+static int recv_request(int sock, struct daemon_request *req, int *fd)
+{
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct iovec iov = { req, sizeof(*req) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    *fd = -1;
+    ssize_t r;
+    do
+        r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    while (r < 0 && errno == EINTR);
+    if (r <= 0)
+        return -1;
+
+    /*
+     * Exactly one descriptor is allowed. Any extra ones are open in this
+     * long-lived process now, so close them all, or a client could run us
+     * out of descriptors.
+     */
+    int nfds = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+    {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n; i++)
+        {
+            int got;
+            memcpy(&got, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (nfds++ == 0)
+                *fd = got;
+            else
+                close(got);
+        }
+    }
+    int bad = nfds > 1 || (msg.msg_flags & MSG_CTRUNC);
+
+    /* The descriptor arrives with the first byte; the rest may come later */
+    if (bad || ((size_t)r < sizeof(*req) && recv_all(sock, (char *)req + r, sizeof(*req) - (size_t)r) < 0))
+    {
+        if (*fd >= 0)
+            close(*fd);
+        return -1;
+    }
+    return 0;
+}
+
+/* ---------- counter side ---------- */
+
+/* Count an open file: mapped if it is a regular file, read() otherwise. Returns 0 or an errno. */
+static int count_fd(int fd, unsigned metrics, struct wc_counts *out)
+{
+    struct wc_stream stream;
+    wc_stream_init(&stream, metrics);
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return errno;
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        size_t size = (size_t)st.st_size;
+        const unsigned char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+            return errno;
+        for (size_t off = 0; off < size; off += DAEMON_SLICE)
+            wc_stream_feed(&stream, map + off, size - off < DAEMON_SLICE ? size - off : DAEMON_SLICE);
+        munmap((void *)map, size);
+    }
+    else
+    {
+        unsigned char buf[64 * 1024];
+        while (1)
+        {
+            ssize_t r = read(fd, buf, sizeof(buf));
+            if (r < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return errno;
+            }
+            if (r == 0)
+                break;
+            wc_stream_feed(&stream, buf, (size_t)r);
+        }
+    }
+
+    struct wc_summary total = wc_stream_finish(&stream);
+    wc_summary_counts(&total, out);
+    return 0;
+}
+
+/* Answer requests on one connection until the client hangs up */
+static void serve_connection(int sock)
+{
+    while (1)
+    {
+        struct daemon_request req;
+        int fd;
+        if (recv_request(sock, &req, &fd) < 0)
+            return;
+
+        struct daemon_reply reply = { DAEMON_MAGIC, 0 };
+        if (req.magic != DAEMON_MAGIC || req.version != DAEMON_VERSION)
+        {
+            if (fd >= 0)
+                close(fd);
+            return; /* not our protocol: drop the connection */
+        }
+
+        /* Without a descriptor there is nothing the client may read: refuse */
+        struct wc_result res = { .metrics = req.metrics & WC_ALL };
+        if (fd < 0)
+        {
+            reply.error = EBADF;
+        }
+        else
+        {
+            reply.error = count_fd(fd, req.metrics & (WC_ALL | WC_UTF8), &res.counts);
+            close(fd);
+        }
+
+        if (send_all(sock, &reply, sizeof(reply)) < 0)
+            return;
+        if (reply.error == 0)
+        {
+            /* Same message Process 2 puts on pipe #2; send_result() would exit on EPIPE */
+            res.magic = RESULT_MAGIC;
+            res.version = RESULT_VERSION;
+            res.length = (uint16_t)sizeof(res);
+            if (send_all(sock, &res, sizeof(res)) < 0)
+                return;
+        }
+    }
+}
+
+static void counter_main(int listen_fd)
+{
+    /* Counters die quietly on SIGTERM from Process 1 */
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_IGN);
+
+    while (1)
+    {
+        int sock = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (sock < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            die_perror("accept");
+        }
+        serve_connection(sock);
+        close(sock);
+    }
+}
+
+static pid_t spawn_counter(int listen_fd)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+        die_perror("fork");
+    if (pid == 0)
+    {
+        counter_main(listen_fd);
+        _exit(EXIT_SUCCESS);
+    }
+    return pid;
+}
+
+/*
+ * Remove the socket file of a daemon that is gone. Anything else at the
+ * path (a regular file, a daemon that still answers) is left alone.
+ * Returns 0 if the path is free for bind(), -1 after printing why not.
+ */
+static int remove_stale_socket(const char *path, const struct sockaddr_un *addr)
+{
+    struct stat st;
+    if (lstat(path, &st) < 0)
+    {
+        if (errno == ENOENT)
+            return 0;
+        fprintf(stderr, "Error: cannot stat \"%s\": %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (!S_ISSOCK(st.st_mode))
+    {
+        fprintf(stderr, "Error: \"%s\" exists and is not a socket.\n", path);
+        return -1;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0)
+        die_perror("socket");
+    int rc = connect(probe, (const struct sockaddr *)addr, sizeof(*addr));
+    int err = errno;
+    close(probe);
+    if (rc == 0)
+    {
+        fprintf(stderr, "Error: a daemon is already listening on \"%s\".\n", path);
+        return -1;
+    }
+    if (err != ECONNREFUSED)
+    {
+        fprintf(stderr, "Error: cannot check \"%s\": %s\n", path, strerror(err));
+        return -1;
+    }
+    if (unlink(path) < 0 && errno != ENOENT)
+    {
+        fprintf(stderr, "Error: cannot remove \"%s\": %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int run_daemon_mode(const struct options *opt)
+{
+    struct sockaddr_un addr;
+    if (make_address(opt->daemon_socket, &addr) < 0)
+    {
+        fprintf(stderr, "Error: socket path \"%s\" is too long.\n", opt->daemon_socket);
+        return EXIT_FAILURE;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        die_perror("socket");
+
+    /* A socket file left by a previous daemon that was killed would block bind() */
+    if (remove_stale_socket(opt->daemon_socket, &addr) < 0)
+    {
+        close(listen_fd);
+        return EXIT_FAILURE;
+    }
+
+    /* Created 0600 from the start (no window before a chmod): other users cannot connect */
+    mode_t old_mask = umask(0177);
+    int bound = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound < 0 || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        fprintf(stderr, "Error: cannot listen on \"%s\": %s\n", opt->daemon_socket, strerror(errno));
+        close(listen_fd);
+        return EXIT_FAILURE;
+    }
+
+    /* Handlers first: a signal between fork() and here would otherwise be lost */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    int workers = opt->jobs >= 1 ? opt->jobs : DAEMON_WORKERS;
+    pid_t *pids = calloc((size_t)workers, sizeof(*pids));
+    if (!pids)
+        die_perror("calloc");
+    for (int i = 0; i < workers; i++)
+        pids[i] = spawn_counter(listen_fd);
+
+    printf("Process 1 (daemon) is listening on \"%s\" with %d counting processes ...\n",
+           opt->daemon_socket, workers);
+
+    /* Keep the pool full until SIGTERM/SIGINT */
+    while (!stop_requested)
+    {
+        pid_t pid = wait(NULL);
+        if (pid < 0)
+            continue; /* EINTR from our own signal handler */
+
+        for (int i = 0; i < workers; i++)
+        {
+            if (pids[i] == pid && !stop_requested)
+            {
+                fprintf(stderr, "Warning: counting process %d exited, starting a new one.\n", (int)pid);
+                pids[i] = spawn_counter(listen_fd);
+            }
+        }
+    }
+
+    for (int i = 0; i < workers; i++)
+        kill(pids[i], SIGTERM);
+    for (int i = 0; i < workers; i++)
+        waitpid(pids[i], NULL, 0);
+
+    close(listen_fd);
+    unlink(opt->daemon_socket);
+    free(pids);
+    printf("Process 1 (daemon) stopped.\n");
+    return EXIT_SUCCESS;
+}
+
+/* ---------- client side ---------- */
+
+int run_client_mode(const struct options *opt, const char *socket_path)
+{
+    struct sockaddr_un addr;
+    if (make_address(socket_path, &addr) < 0)
+        return -1;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+
+    /* Open the file here, so it is read with our permissions, not the daemon's */
+    int fd = open(opt->filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: cannot open file \"%s\": %s\n", opt->filename, strerror(errno));
+        close(sock);
+        return EXIT_FAILURE;
+    }
+
+    struct daemon_request req = { DAEMON_MAGIC, DAEMON_VERSION, 0, opt->metrics, 0 };
+
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &fd, sizeof(int));
+
+    ssize_t w;
+    do
+        w = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    while (w < 0 && errno == EINTR);
+    close(fd); /* the daemon has its own copy now */
+
+    struct daemon_reply reply;
+    struct wc_result res;
+    if (w != (ssize_t)sizeof(req) || recv_all(sock, &reply, sizeof(reply)) < 0 || reply.magic != DAEMON_MAGIC)
+    {
+        close(sock);
+        return -1;
+    }
+    if (reply.error != 0)
+    {
+        fprintf(stderr, "Error: daemon could not count \"%s\": %s\n", opt->filename, strerror(reply.error));
+        close(sock);
+        return EXIT_FAILURE;
+    }
+    if (recv_result(sock, &res) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    close(sock);
+
+    print_counts(res.metrics, &res.counts);
+    result_cache_store(opt->cache, &res.counts);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,521 @@
+/*
+ * decompress.c: Process 3, the decompression stage for compressed input
+ *
+ * When the file starts with a gzip or zstd magic number, run_pipe_mode()
+ * puts one more process into the chain:
+ *
+ *   Process 1 --pipe #0--> Process 3 --pipe #1--> Process 2 --pipe #2--> Process 1
+ *   (reads the file)       (decompresses)         (counts, as always)
+ *
+ * gzip: one zlib inflate stream, member after member (concatenated .gz
+ * files are valid gzip). A gzip member cannot be located without
+ * decompressing everything before it, so this stays sequential.
+ *
+ * zstd: a file made of several independent frames (pzstd, concatenated
+ * or appended .zst files) is decompressed in parallel. The main thread
+ * cuts frames off pipe #0 and deals them into a ring of slots; worker
+ * threads decompress whole frames; a writer thread sends them to pipe #1
+ * in file order. A frame without a declared size, or bigger than
+ * ZSTD_FRAME_MAX, is streamed by the main thread once the ring is empty.
+ *
+ * Memory: frames in the ring (compressed + decompressed) never hold more
+ * than ZSTD_RING_BUDGET together, whatever the number of workers; a slot
+ * frees its buffers as soon as the frame is written. The main thread's
+ * input buffer adds at most 2 * ZSTD_FRAME_MAX, so Process 3 stays under
+ * about 320 MiB even for a file of huge frames on a big machine.
+ *
+ * libzstd is opened with dlopen(): its headers are often not installed
+ * where the shared library is, and gzip input must keep working without
+ * it. The few declarations needed follow zstd.h (stable API, v1.4+).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <zlib.h>
+
+#include "pwordcount.h"
+#include "ioutil.h"
+
+/* Bytes read from pipe #0 at a time, and decompressed bytes per write to pipe #1 */
+#define DECOMP_IN_CHUNK (256 * 1024)
+#define DECOMP_OUT_CHUNK (256 * 1024)
+
+/* Frames up to this size (compressed and decompressed) go to the workers */
+#define ZSTD_FRAME_MAX (32u * 1024 * 1024)
+
+/* Bytes all frames in the ring may hold at once; at least one whole frame (2 * ZSTD_FRAME_MAX) */
+#define ZSTD_RING_BUDGET (256u * 1024 * 1024)
+
+/* Ring slots per worker: one being decompressed, one waiting to be written */
+#define ZSTD_SLOTS_PER_WORKER 2
+
+#define ZSTD_MAX_WORKERS 16
+
+enum compression compression_detect(const char *filename)
+{
+    unsigned char magic[4];
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return COMPRESSION_NONE;
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return COMPRESSION_GZIP;
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+const char *compression_name(enum compression compression)
+{
+    return compression == COMPRESSION_GZIP ? "gzip" : compression == COMPRESSION_ZSTD ? "zstd" : "none";
+}
+
+/* read() with EINTR retry; 0 at EOF */
+static size_t read_some(int fd, void *buf, size_t n)
+{
+    while (1)
+    {
+        ssize_t r = read(fd, buf, n);
+        if (r >= 0)
+            return (size_t)r;
+        if (errno != EINTR)
+            die_perror("read(pipe0)");
+    }
+}
+
+static void fail(const char *name, const char *what)
+{
+    fprintf(stderr, "Error: cannot decompress \"%s\": %s\n", name, what);
+    exit(EXIT_FAILURE);
+}
+
+/* ---------- gzip ---------- */
+
+static int gunzip_stream(const char *name, int in_fd, int out_fd)
+{
+    unsigned char *in = malloc(DECOMP_IN_CHUNK);
+    unsigned char *out = malloc(DECOMP_OUT_CHUNK);
+    if (!in || !out)
+        die_perror("malloc");
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) /* 16: gzip wrapper only */
+        fail(name, "inflateInit2 failed");
+
+    int in_member = 0;
+    unsigned members = 0;
+    while (1)
+    {
+        if (zs.avail_in == 0)
+        {
+            zs.avail_in = (uInt)read_some(in_fd, in, DECOMP_IN_CHUNK);
+            zs.next_in = in;
+            if (zs.avail_in == 0)
+                break;
+        }
+
+        zs.next_out = out;
+        zs.avail_out = DECOMP_OUT_CHUNK;
+        int ret = inflate(&zs, Z_NO_FLUSH);
+
+        /* Like gzip(1): junk (often zero padding) after a complete member is ignored */
+        if (ret == Z_DATA_ERROR && members > 0 && !in_member)
+        {
+            fprintf(stderr, "Warning: \"%s\": trailing garbage after gzip data ignored.\n", name);
+            while (read_some(in_fd, in, DECOMP_IN_CHUNK) > 0)
+                ;
+            break;
+        }
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR)
+            fail(name, zs.msg ? zs.msg : "corrupt gzip data");
+
+        write_all(out_fd, out, DECOMP_OUT_CHUNK - zs.avail_out);
+
+        if (ret == Z_STREAM_END)
+        {
+            /* The next member, if any, starts with a new gzip header */
+            members++;
+            in_member = 0;
+            inflateReset(&zs);
+        }
+        else
+        {
+            in_member = 1;
+        }
+    }
+
+    if (in_member || members == 0)
+        fail(name, "unexpected end of gzip data");
+
+    inflateEnd(&zs);
+    free(in);
+    free(out);
+    return EXIT_SUCCESS;
+}
+
+/* ---------- zstd (libzstd via dlopen) ---------- */
+
+/* ZSTD_inBuffer / ZSTD_outBuffer */
+struct zstd_in
+{
+    const void *src;
+    size_t size;
+    size_t pos;
+};
+
+struct zstd_out
+{
+    void *dst;
+    size_t size;
+    size_t pos;
+};
+
+#define ZSTD_CONTENTSIZE_UNKNOWN (0ULL - 1)
+#define ZSTD_CONTENTSIZE_ERROR (0ULL - 2)
+#define ZSTD_FRAMEHEADERSIZE_MAX 18
+#define ZSTD_ERROR_SRCSIZE_WRONG 72 /* ZSTD_error_srcSize_wrong, zstd_errors.h */
+
+static struct
+{
+    void *(*createDCtx)(void);
+    size_t (*freeDCtx)(void *dctx);
+    size_t (*decompressDCtx)(void *dctx, void *dst, size_t cap, const void *src, size_t len);
+    size_t (*decompressStream)(void *dctx, struct zstd_out *out, struct zstd_in *in);
+    unsigned long long (*getFrameContentSize)(const void *src, size_t len);
+    size_t (*findFrameCompressedSize)(const void *src, size_t len);
+    unsigned (*isError)(size_t code);
+    const char *(*getErrorName)(size_t code);
+    int (*getErrorCode)(size_t code);
+} zstd;
+
+static int zstd_load(void)
+{
+    void *lib = dlopen("libzstd.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (!lib)
+        return -1;
+
+#define ZSTD_SYM(field, symbol)                         \
+    if (!(*(void **)&zstd.field = dlsym(lib, symbol))) \
+        return -1
+    ZSTD_SYM(createDCtx, "ZSTD_createDCtx");
+    ZSTD_SYM(freeDCtx, "ZSTD_freeDCtx");
+    ZSTD_SYM(decompressDCtx, "ZSTD_decompressDCtx");
+    ZSTD_SYM(decompressStream, "ZSTD_decompressStream");
+    ZSTD_SYM(getFrameContentSize, "ZSTD_getFrameContentSize");
+    ZSTD_SYM(findFrameCompressedSize, "ZSTD_findFrameCompressedSize");
+    ZSTD_SYM(isError, "ZSTD_isError");
+    ZSTD_SYM(getErrorName, "ZSTD_getErrorName");
+    ZSTD_SYM(getErrorCode, "ZSTD_getErrorCode");
+#undef ZSTD_SYM
+    return 0;
+}
+
+enum slot_state
+{
+    SLOT_FREE,
+    SLOT_FILLED, /* compressed frame waiting for a worker */
+    SLOT_BUSY,
+    SLOT_DONE    /* decompressed, waiting for the writer */
+};
+
+struct frame_slot
+{
+    enum slot_state state;
+    unsigned char *src; /* both allocated for one frame, freed once it is written */
+    size_t src_len;
+    unsigned char *dst;
+    size_t dst_len, dst_cap;
+};
+
+struct zstd_pool
+{
+    const char *name;
+    int out_fd;
+    pthread_mutex_t lock;
+    pthread_cond_t changed; /* any slot changed state, or the input ended */
+    struct frame_slot *slots;
+    unsigned nslots;
+    unsigned long long filled;  /* frames handed to the ring so far (frame n uses slot n % nslots) */
+    unsigned long long taken;   /* frames picked up by a worker */
+    unsigned long long written; /* frames written to pipe #1 */
+    size_t ring_bytes;          /* src_len + dst_cap of every frame not yet written */
+    int eof;
+};
+
+static void grow(unsigned char **buf, size_t *cap, size_t need)
+{
+    if (need <= *cap)
+        return;
+    size_t n = *cap ? *cap : DECOMP_IN_CHUNK;
+    while (n < need)
+        n *= 2;
+    unsigned char *p = realloc(*buf, n);
+    if (!p)
+        die_perror("realloc");
+    *buf = p;
+    *cap = n;
+}
+
+static void *zstd_worker(void *arg)
+{
+    struct zstd_pool *p = arg;
+    void *dctx = zstd.createDCtx();
+    if (!dctx)
+        fail(p->name, "ZSTD_createDCtx failed");
+
+    pthread_mutex_lock(&p->lock);
+    while (1)
+    {
+        while (p->taken == p->filled && !p->eof)
+            pthread_cond_wait(&p->changed, &p->lock);
+        if (p->taken == p->filled)
+            break;
+        struct frame_slot *s = &p->slots[p->taken++ % p->nslots];
+        s->state = SLOT_BUSY;
+        pthread_mutex_unlock(&p->lock);
+
+        /* The declared content size was checked against ZSTD_FRAME_MAX already */
+        size_t n = zstd.decompressDCtx(dctx, s->dst, s->dst_cap, s->src, s->src_len);
+        if (zstd.isError(n))
+            fail(p->name, zstd.getErrorName(n));
+        s->dst_len = n;
+
+        pthread_mutex_lock(&p->lock);
+        s->state = SLOT_DONE;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    zstd.freeDCtx(dctx);
+    return NULL;
+}
+
+static void *zstd_writer(void *arg)
+{
+    struct zstd_pool *p = arg;
+
+    pthread_mutex_lock(&p->lock);
+    while (1)
+    {
+        struct frame_slot *s = &p->slots[p->written % p->nslots];
+        while (!(p->written < p->filled && s->state == SLOT_DONE) && !(p->eof && p->written == p->filled))
+            pthread_cond_wait(&p->changed, &p->lock);
+        if (p->written == p->filled)
+            break;
+        pthread_mutex_unlock(&p->lock);
+
+        write_all(p->out_fd, s->dst, s->dst_len);
+        size_t bytes = s->src_len + s->dst_cap;
+        free(s->src);
+        free(s->dst);
+        s->src = s->dst = NULL;
+
+        pthread_mutex_lock(&p->lock);
+        s->state = SLOT_FREE;
+        p->written++;
+        p->ring_bytes -= bytes;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/* Main thread: hand frame buf[0, len) to the next free slot */
+static void zstd_submit(struct zstd_pool *p, const unsigned char *buf, size_t len, size_t content_size)
+{
+    /* Wait for a free slot and room in the budget; an empty ring always takes the frame */
+    size_t need = len + content_size;
+    pthread_mutex_lock(&p->lock);
+    while (p->filled - p->written == p->nslots ||
+           (p->filled != p->written && p->ring_bytes + need > ZSTD_RING_BUDGET))
+        pthread_cond_wait(&p->changed, &p->lock);
+    struct frame_slot *s = &p->slots[p->filled % p->nslots];
+    p->ring_bytes += need;
+    pthread_mutex_unlock(&p->lock);
+
+    /* A free slot is ours alone until it is marked filled */
+    s->src = malloc(len ? len : 1);
+    s->dst = malloc(content_size ? content_size : 1);
+    if (!s->src || !s->dst)
+        die_perror("malloc");
+    memcpy(s->src, buf, len);
+    s->src_len = len;
+    s->dst_cap = content_size;
+
+    pthread_mutex_lock(&p->lock);
+    s->state = SLOT_FILLED;
+    p->filled++;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* Main thread: wait until every frame handed out so far is in pipe #1 */
+static void zstd_drain(struct zstd_pool *p)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->written != p->filled)
+        pthread_cond_wait(&p->changed, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * Stream the frame at the start of buf (*len bytes buffered, more to come
+ * from in_fd) straight to out_fd. On return buf holds what followed it.
+ */
+static void zstd_stream_frame(struct zstd_pool *p, void *dctx, int in_fd, unsigned char *buf, size_t cap,
+                              size_t *len, unsigned char *out)
+{
+    struct zstd_in in = { buf, *len, 0 };
+    while (1)
+    {
+        struct zstd_out o = { out, DECOMP_OUT_CHUNK, 0 };
+        size_t ret = zstd.decompressStream(dctx, &o, &in);
+        if (zstd.isError(ret))
+            fail(p->name, zstd.getErrorName(ret));
+        write_all(p->out_fd, out, o.pos);
+        if (ret == 0)
+            break; /* frame complete and flushed */
+
+        if (in.pos == in.size && o.pos < o.size)
+        {
+            in.size = read_some(in_fd, buf, cap);
+            in.pos = 0;
+            if (in.size == 0)
+                fail(p->name, "unexpected end of zstd data");
+        }
+    }
+
+    memmove(buf, buf + in.pos, in.size - in.pos);
+    *len = in.size - in.pos;
+}
+
+static int unzstd_stream(const char *name, int in_fd, int out_fd)
+{
+    if (zstd_load() < 0)
+    {
+        const char *why = dlerror();
+        fprintf(stderr, "Error: cannot decompress \"%s\": zstd input needs libzstd.so.1 (%s)\n", name,
+                why ? why : "unknown error");
+        return EXIT_FAILURE;
+    }
+
+    /* Process 1 and Process 2 have a CPU each; the rest decompress */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nworkers = cpus > 2 ? (int)cpus - 2 : 1;
+    if (nworkers > ZSTD_MAX_WORKERS)
+        nworkers = ZSTD_MAX_WORKERS;
+
+    struct zstd_pool p;
+    memset(&p, 0, sizeof(p));
+    p.name = name;
+    p.out_fd = out_fd;
+    p.nslots = (unsigned)nworkers * ZSTD_SLOTS_PER_WORKER;
+    p.slots = calloc(p.nslots, sizeof(*p.slots));
+    if (!p.slots)
+        die_perror("calloc");
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.changed, NULL);
+
+    pthread_t *threads = calloc((size_t)nworkers + 1, sizeof(*threads));
+    if (!threads)
+        die_perror("calloc");
+    for (int i = 0; i <= nworkers; i++)
+    {
+        int rc = pthread_create(&threads[i], NULL, i == 0 ? zstd_writer : zstd_worker, &p);
+        if (rc != 0)
+        {
+            errno = rc;
+            die_perror("pthread_create");
+        }
+    }
+
+    /* Frames are cut from buf; it only grows while one frame does not fit yet */
+    size_t cap = DECOMP_IN_CHUNK, len = 0;
+    unsigned char *buf = malloc(cap);
+    unsigned char *out = malloc(DECOMP_OUT_CHUNK);
+    void *dctx = zstd.createDCtx();
+    if (!buf || !out || !dctx)
+        die_perror("malloc");
+
+    unsigned long long streamed = 0;
+    int eof = 0;
+    while (len > 0 || !eof)
+    {
+        /* Enough for any frame header, unless the input ends first */
+        if (!eof && len < ZSTD_FRAMEHEADERSIZE_MAX)
+        {
+            size_t r = read_some(in_fd, buf + len, cap - len);
+            eof = r == 0;
+            len += r;
+            continue;
+        }
+
+        unsigned long long size = zstd.getFrameContentSize(buf, len);
+        if (size == ZSTD_CONTENTSIZE_ERROR)
+            fail(name, eof && len < ZSTD_FRAMEHEADERSIZE_MAX ? "unexpected end of zstd data" : "not zstd data");
+
+        if (size != ZSTD_CONTENTSIZE_UNKNOWN && size <= ZSTD_FRAME_MAX)
+        {
+            size_t frame = zstd.findFrameCompressedSize(buf, len);
+            if (!zstd.isError(frame))
+            {
+                zstd_submit(&p, buf, frame, (size_t)size);
+                memmove(buf, buf + frame, len - frame);
+                len -= frame;
+                continue;
+            }
+            if (zstd.getErrorCode(frame) != ZSTD_ERROR_SRCSIZE_WRONG || eof)
+                fail(name, eof ? "unexpected end of zstd data" : zstd.getErrorName(frame));
+
+            /* Incomplete: read more of it, unless it is already too big to buffer */
+            if (len < ZSTD_FRAME_MAX)
+            {
+                grow(&buf, &cap, len + DECOMP_IN_CHUNK);
+                size_t r = read_some(in_fd, buf + len, cap - len);
+                eof = r == 0;
+                len += r;
+                continue;
+            }
+        }
+
+        /* Unknown or huge: decompress it here, in order, after everything before it */
+        zstd_drain(&p);
+        zstd_stream_frame(&p, dctx, in_fd, buf, cap, &len, out);
+        streamed++;
+    }
+
+    pthread_mutex_lock(&p.lock);
+    p.eof = 1;
+    pthread_cond_broadcast(&p.changed);
+    pthread_mutex_unlock(&p.lock);
+    for (int i = 0; i <= nworkers; i++)
+        pthread_join(threads[i], NULL);
+
+    if (p.filled + streamed == 0)
+        fail(name, "no zstd frame found");
+    if (p.filled > 1)
+        printf("Process 3 decompressed %llu zstd frames with %d worker threads ...\n", p.filled, nworkers);
+
+    zstd.freeDCtx(dctx);
+    free(p.slots);
+    free(threads);
+    free(buf);
+    free(out);
+    return EXIT_SUCCESS;
+}
+
+int decompress_main(enum compression compression, const char *name, int in_fd, int out_fd)
+{
+    if (compression == COMPRESSION_GZIP)
+        return gunzip_stream(name, in_fd, out_fd);
+    return unzstd_stream(name, in_fd, out_fd);
+}
@@ -0,0 +1,387 @@
+/*
+ * follow.c: the "--follow" mode of pwordcount
+ *
+ * Live totals for a file that keeps growing (an active log), without
+ * re-reading it and without polling:
+ *
+ *   Process 1: read the file to EOF into pipe #1, then sleep in poll() on
+ *              an inotify descriptor; on every event send only the bytes
+ *              appended since, and print each update arriving on pipe #2.
+ *   Process 2: count whatever arrives with the same wc_stream as always,
+ *              and every --interval send the totals so far on pipe #2
+ *              (only if something new was counted).
+ *
+ * Log rotation: Process 1 watches the file AND its directory. After any
+ * event it first drains the descriptor it has open (a renamed file may
+ * still get its last lines), then checks:
+ *   - the file is now shorter than what we read: truncated, continue at 0;
+ *   - the path names another inode: rotated, open the new file at 0.
+ * Old data is never sent twice, and the totals keep accumulating.
+ *
+ * SIGINT/SIGTERM stop following: Process 1 closes pipe #1, Process 2
+ * sends its final totals and both exit normally. Without inotify (e.g. a
+ * seccomp policy) Process 1 falls back to checking once per interval.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <libgen.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "pwordcount.h"
+#include "wordcount.h"
+#include "ioutil.h"
+#include "result.h"
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* ---------- Process 2 ---------- */
+
+static void send_totals(int fd, const struct options *opt, const struct wc_stream *stream)
+{
+    /* Finish a copy: the real stream must keep its partial word/character */
+    struct wc_stream copy = *stream;
+    struct wc_summary total = wc_stream_finish(&copy);
+    struct wc_result res = { .metrics = opt->metrics & WC_ALL };
+    wc_summary_counts(&total, &res.counts);
+    send_result(fd, &res);
+}
+
+static int counter_main(const struct options *opt, int in_fd, int out_fd)
+{
+    size_t chunk = opt->chunk ? opt->chunk : BUF_SIZE;
+    unsigned char *buf = malloc(chunk);
+    if (!buf)
+        die_perror("malloc");
+
+    struct wc_stream stream;
+    wc_stream_init(&stream, opt->metrics);
+
+    int changed = 0;
+    uint64_t next = now_ms() + opt->interval_ms;
+
+    while (1)
+    {
+        uint64_t now = now_ms();
+        if (now >= next)
+        {
+            if (changed)
+                send_totals(out_fd, opt, &stream);
+            changed = 0;
+            next = now + opt->interval_ms;
+        }
+
+        struct pollfd p = { in_fd, POLLIN, 0 };
+        int n = poll(&p, 1, (int)(next - now));
+        if (n < 0 && errno != EINTR)
+            die_perror("poll");
+        if (n <= 0)
+            continue;
+
+        ssize_t r = read(in_fd, buf, chunk);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            die_perror("read(pipe1)");
+        }
+        if (r == 0)
+            break; /* Process 1 stopped following */
+
+        wc_stream_feed(&stream, buf, (size_t)r);
+        changed = 1;
+    }
+
+    free(buf);
+    send_totals(out_fd, opt, &stream);
+    return EXIT_SUCCESS;
+}
+
+/* ---------- Process 1 ---------- */
+
+struct follower
+{
+    const char *filename;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    off_t pos;         /* bytes of the current file already sent */
+    unsigned char *buf;
+    size_t chunk;
+    int inotify_fd;    /* -1 without inotify */
+    int file_watch;
+    int out_fd;        /* pipe #1 */
+    int result_fd;     /* pipe #2 */
+};
+
+/* Print every update Process 2 has sent so far, without blocking. Returns -1 if it is gone. */
+static int drain_results(struct follower *f, const struct options *opt)
+{
+    while (1)
+    {
+        struct pollfd p = { f->result_fd, POLLIN, 0 };
+        if (poll(&p, 1, 0) <= 0)
+            return 0;
+        /* One message is far below PIPE_BUF, so it arrives whole */
+        struct wc_result res;
+        if (recv_result(f->result_fd, &res) < 0)
+            return -1;
+        printf("Process 1 received updated totals from Process 2 ...\n");
+        print_counts(opt->metrics & WC_ALL, &res.counts);
+    }
+}
+
+static int open_target(struct follower *f)
+{
+    int fd = open(f->filename, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    if (f->inotify_fd >= 0)
+    {
+        if (f->file_watch >= 0)
+            inotify_rm_watch(f->inotify_fd, f->file_watch);
+        f->file_watch = inotify_add_watch(f->inotify_fd, f->filename,
+                                          IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    }
+
+    if (f->fd >= 0)
+        close(f->fd);
+    f->fd = fd;
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+    f->pos = 0;
+    return 0;
+}
+
+/* Send everything between f->pos and the current end of the open file */
+static int send_new_bytes(struct follower *f, const struct options *opt)
+{
+    while (!stop_requested)
+    {
+        ssize_t r = pread(f->fd, f->buf, f->chunk, f->pos);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error: failed while reading \"%s\": %s\n", f->filename, strerror(errno));
+            return -1;
+        }
+        if (r == 0)
+            break;
+        write_all(f->out_fd, f->buf, (size_t)r);
+        f->pos += r;
+
+        /* A big backlog must not let pipe #2 fill up behind our back */
+        if (drain_results(f, opt) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* After any event (or timeout): drain, then look for truncation and rotation */
+static int catch_up(struct follower *f, const struct options *opt)
+{
+    if (send_new_bytes(f, opt) < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(f->fd, &st) == 0 && st.st_size < f->pos)
+    {
+        printf("Process 1: file \"%s\" was truncated, following it from its new start ...\n", f->filename);
+        f->pos = 0;
+        if (send_new_bytes(f, opt) < 0)
+            return -1;
+    }
+
+    /* A missing path is a rotation in progress; keep the old file until the new one appears */
+    if (stat(f->filename, &st) == 0 && (st.st_dev != f->dev || st.st_ino != f->ino))
+    {
+        if (open_target(f) == 0)
+        {
+            printf("Process 1: file \"%s\" was rotated, following the new file ...\n", f->filename);
+            if (send_new_bytes(f, opt) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int follow_loop(struct follower *f, const struct options *opt)
+{
+    if (catch_up(f, opt) < 0)
+        return -1;
+
+    printf("Process 1 is following file \"%s\" (Ctrl-C to stop) ...\n", f->filename);
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (!stop_requested)
+    {
+        struct pollfd p[2] = { { f->result_fd, POLLIN, 0 }, { f->inotify_fd, POLLIN, 0 } };
+        int n = poll(p, f->inotify_fd >= 0 ? 2 : 1, f->inotify_fd >= 0 ? -1 : (int)opt->interval_ms);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            die_perror("poll");
+        }
+
+        if (p[0].revents && drain_results(f, opt) < 0)
+            return -1;
+
+        /* Which event it was does not matter: catch_up() re-checks everything */
+        if (f->inotify_fd >= 0 && (p[1].revents & POLLIN) && read(f->inotify_fd, events, sizeof(events)) < 0 &&
+            errno != EINTR && errno != EAGAIN)
+            die_perror("read(inotify)");
+
+        if (catch_up(f, opt) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int run_follow_mode(const struct options *opt)
+{
+    struct follower f;
+    memset(&f, 0, sizeof(f));
+    f.filename = opt->filename;
+    f.fd = -1;
+    f.file_watch = -1;
+    f.chunk = opt->chunk ? opt->chunk : BUF_SIZE;
+
+    f.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (f.inotify_fd < 0)
+        fprintf(stderr, "Warning: inotify is not available (%s), checking the file every interval.\n",
+                strerror(errno));
+
+    if (open_target(&f) < 0)
+    {
+        fprintf(stderr, "Error: cannot open file \"%s\": %s\n", opt->filename, strerror(errno));
+        if (f.inotify_fd >= 0)
+            close(f.inotify_fd);
+        return EXIT_FAILURE;
+    }
+
+    /* The directory tells us when a new file takes the name (rotation) */
+    if (f.inotify_fd >= 0)
+    {
+        char *copy = strdup(opt->filename);
+        if (!copy)
+            die_perror("strdup");
+        inotify_add_watch(f.inotify_fd, dirname(copy), IN_CREATE | IN_MOVED_TO);
+        free(copy);
+    }
+
+    int pipe1[2]; /* parent -> child: appended bytes */
+    int pipe2[2]; /* child -> parent: totals, once per interval */
+    if (pipe(pipe1) == -1)
+        die_perror("pipe(pipe1)");
+    if (pipe(pipe2) == -1)
+        die_perror("pipe(pipe2)");
+
+    /* No SA_RESTART: the signal must interrupt poll() */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        die_perror("fork");
+
+    if (pid == 0)
+    {
+        /* =========================
+         * Process 2 (Child)
+         * ========================= */
+        close(pipe1[WRITE_END]);
+        close(pipe2[READ_END]);
+        close(f.fd);
+        if (f.inotify_fd >= 0)
+            close(f.inotify_fd);
+
+        /* Ctrl-C reaches the whole process group; Process 2 stops at EOF on pipe #1 instead */
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_IGN);
+
+        int rc = counter_main(opt, pipe1[READ_END], pipe2[WRITE_END]);
+        close(pipe1[READ_END]);
+        close(pipe2[WRITE_END]);
+        return rc;
+    }
+
+    /* =========================
+     * Process 1 (Parent)
+     * ========================= */
+    close(pipe1[READ_END]);
+    close(pipe2[WRITE_END]);
+
+    f.out_fd = pipe1[WRITE_END];
+    f.result_fd = pipe2[READ_END];
+    f.buf = malloc(f.chunk);
+    if (!f.buf)
+        die_perror("malloc");
+
+    printf("Process 1 is reading file \"%s\" now ...\n", f.filename);
+    int rc = follow_loop(&f, opt);
+
+    /* EOF on pipe #1: Process 2 sends its final totals */
+    close(pipe1[WRITE_END]);
+    if (rc == 0)
+    {
+        /* The last message is the final one; an interval update may still be queued before it */
+        struct wc_result res, last;
+        int got = 0;
+        while (recv_result(f.result_fd, &res) == 0)
+        {
+            last = res;
+            got = 1;
+        }
+        if (got)
+        {
+            printf("Process 1 stopped following; final totals:\n");
+            print_counts(opt->metrics & WC_ALL, &last.counts);
+        }
+        else
+        {
+            fprintf(stderr, "Error: did not receive wordcount result from Process 2.\n");
+            rc = -1;
+        }
+    }
+
+    close(pipe2[READ_END]);
+    waitpid(pid, NULL, 0);
+    free(f.buf);
+    close(f.fd);
+    if (f.inotify_fd >= 0)
+        close(f.inotify_fd);
+    return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,488 @@
+#include "freq.h"
+#include "ioutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+/* Keys are copied into blocks of this size (bigger words get their own block) */
+#define ARENA_BLOCK (1024 * 1024)
+
+/* Start small; the table doubles whenever it gets 70% full */
+#define INITIAL_CAPACITY 1024
+
+#define FREQ_MAGIC 0x46435750u /* "PWCF" read as little-endian bytes */
+
+struct freq_arena_block
+{
+    struct freq_arena_block *next;
+    size_t used;
+    size_t size;
+    unsigned char data[];
+};
+
+/* ---------- hashing ---------- */
+
+static inline uint64_t mix64(uint64_t h)
+{
+    /* MurmurHash3 finalizer: every input bit affects every output bit */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t freq_hash(const unsigned char *key, size_t len)
+{
+    /* 8 bytes per multiply; words are short, so this is mostly 1-2 rounds */
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ (len * 0x100000001b3ull);
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, key + i, 8);
+        h = (h ^ mix64(w)) * 0x9e3779b97f4a7c15ull;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, key + i, len - i);
+    h ^= mix64(tail ^ 0x2545f4914f6cdd1dull);
+    return mix64(h);
+}
+
+/* ---------- arena ---------- */
+
+static const unsigned char *arena_copy(struct freq_table *t, const unsigned char *key, size_t len)
+{
+    struct freq_arena_block *b = t->arena;
+
+    if (!b || b->size - b->used < len)
+    {
+        size_t size = len > ARENA_BLOCK ? len : ARENA_BLOCK;
+        b = malloc(sizeof(*b) + size);
+        if (!b)
+            die_perror("malloc");
+        b->next = t->arena;
+        b->used = 0;
+        b->size = size;
+        t->arena = b;
+    }
+
+    unsigned char *dst = b->data + b->used;
+    memcpy(dst, key, len);
+    b->used += len;
+    return dst;
+}
+
+/* ---------- table ---------- */
+
+static void alloc_slots(struct freq_table *t, size_t capacity)
+{
+    t->slots = calloc(capacity, sizeof(*t->slots));
+    if (!t->slots)
+        die_perror("calloc");
+    t->capacity = capacity;
+}
+
+void freq_init(struct freq_table *t)
+{
+    memset(t, 0, sizeof(*t));
+    alloc_slots(t, INITIAL_CAPACITY);
+}
+
+void freq_free(struct freq_table *t)
+{
+    free(t->slots);
+    while (t->arena)
+    {
+        struct freq_arena_block *next = t->arena->next;
+        free(t->arena);
+        t->arena = next;
+    }
+    memset(t, 0, sizeof(*t));
+}
+
+/* Double the slot array; keys stay where they are in the arena */
+static void grow(struct freq_table *t)
+{
+    struct freq_entry *old = t->slots;
+    size_t old_cap = t->capacity;
+
+    alloc_slots(t, old_cap * 2);
+    size_t mask = t->capacity - 1;
+
+    for (size_t i = 0; i < old_cap; i++)
+    {
+        if (!old[i].key)
+            continue;
+        size_t j = old[i].hash & mask;
+        while (t->slots[j].key)
+            j = (j + 1) & mask;
+        t->slots[j] = old[i];
+    }
+
+    free(old);
+}
+
+void freq_add_count(struct freq_table *t, const unsigned char *key, size_t len,
+                    uint64_t hash, uint64_t count)
+{
+    t->total += count;
+
+    size_t mask = t->capacity - 1;
+    size_t j = hash & mask;
+
+    /* Linear probing: neighbours share cache lines */
+    while (t->slots[j].key)
+    {
+        struct freq_entry *e = &t->slots[j];
+        if (e->hash == hash && e->len == len && memcmp(e->key, key, len) == 0)
+        {
+            e->count += count;
+            return;
+        }
+        j = (j + 1) & mask;
+    }
+
+    struct freq_entry *e = &t->slots[j];
+    e->hash = hash;
+    e->key = arena_copy(t, key, len);
+    e->len = (uint32_t)len;
+    e->count = count;
+    t->used++;
+
+    if (t->used * 10 > t->capacity * 7)
+        grow(t);
+}
+
+void freq_add(struct freq_table *t, const unsigned char *key, size_t len)
+{
+    freq_add_count(t, key, len, freq_hash(key, len), 1);
+}
+
+/* ---------- top-K ---------- */
+
+/* "a comes before b" in the output: higher count first, then by key */
+static int ranks_before(const struct freq_entry *a, const struct freq_entry *b)
+{
+    if (a->count != b->count)
+        return a->count > b->count;
+
+    size_t n = a->len < b->len ? a->len : b->len;
+    int c = memcmp(a->key, b->key, n);
+    if (c != 0)
+        return c < 0;
+    return a->len < b->len;
+}
+
+static int compare_rank(const void *pa, const void *pb)
+{
+    const struct freq_entry *a = pa;
+    const struct freq_entry *b = pb;
+    if (ranks_before(a, b))
+        return -1;
+    if (ranks_before(b, a))
+        return 1;
+    return 0;
+}
+
+void freq_sort(struct freq_entry *e, size_t n)
+{
+    qsort(e, n, sizeof(*e), compare_rank);
+}
+
+/* Min-heap on rank: the root is the entry that would be dropped first */
+static void heap_sift_down(struct freq_entry *h, size_t n, size_t i)
+{
+    while (1)
+    {
+        size_t l = 2 * i + 1, r = l + 1, worst = i;
+        if (l < n && ranks_before(&h[worst], &h[l]))
+            worst = l;
+        if (r < n && ranks_before(&h[worst], &h[r]))
+            worst = r;
+        if (worst == i)
+            return;
+        struct freq_entry tmp = h[i];
+        h[i] = h[worst];
+        h[worst] = tmp;
+        i = worst;
+    }
+}
+
+struct freq_entry *freq_top(const struct freq_table *t, size_t k, size_t *n_out)
+{
+    if (k == 0 || k > t->used)
+        k = t->used;
+
+    struct freq_entry *heap = malloc((k ? k : 1) * sizeof(*heap));
+    if (!heap)
+        die_perror("malloc");
+
+    size_t n = 0;
+    for (size_t i = 0; i < t->capacity; i++)
+    {
+        const struct freq_entry *e = &t->slots[i];
+        if (!e->key)
+            continue;
+
+        if (n < k)
+        {
+            heap[n++] = *e;
+            if (n == k)
+            {
+                for (size_t j = k / 2; j-- > 0;)
+                    heap_sift_down(heap, k, j);
+            }
+        }
+        else if (ranks_before(e, &heap[0]))
+        {
+            heap[0] = *e;
+            heap_sift_down(heap, k, 0);
+        }
+    }
+
+    freq_sort(heap, n);
+    *n_out = n;
+    return heap;
+}
+
+/* ---------- wire format ---------- */
+
+struct freq_header
+{
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t entries;
+    uint64_t distinct;
+};
+
+struct freq_record
+{
+    uint64_t count;
+    uint32_t len;
+    uint32_t reserved;
+};
+
+void freq_send(int fd, const struct freq_entry *e, size_t n, uint64_t distinct)
+{
+    struct freq_header h = { FREQ_MAGIC, 0, n, distinct };
+    write_all(fd, &h, sizeof(h));
+
+    /* Batch small records so a big table is not two syscalls per word */
+    unsigned char out[64 * 1024];
+    size_t out_len = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        struct freq_record r = { e[i].count, e[i].len, 0 };
+
+        if (out_len + sizeof(r) + e[i].len > sizeof(out))
+        {
+            write_all(fd, out, out_len);
+            out_len = 0;
+        }
+        if (sizeof(r) + e[i].len > sizeof(out))
+        {
+            write_all(fd, &r, sizeof(r));
+            write_all(fd, e[i].key, e[i].len);
+            continue;
+        }
+
+        memcpy(out + out_len, &r, sizeof(r));
+        memcpy(out + out_len + sizeof(r), e[i].key, e[i].len);
+        out_len += sizeof(r) + e[i].len;
+    }
+
+    write_all(fd, out, out_len);
+}
+
+/*
+ * stdout is unbuffered (see main), and a full table can have millions of
+ * lines, so "count word" lines are formatted into our own buffer and
+ * write()n in big pieces.
+ */
+struct print_buf
+{
+    size_t len;
+    char data[64 * 1024];
+};
+
+static void print_entry(struct print_buf *pb, uint64_t count, const unsigned char *word, size_t len)
+{
+    /* Flush first if this line might not fit (long words go out directly) */
+    if (pb->len + len + 32 > sizeof(pb->data))
+    {
+        write_all(STDOUT_FILENO, pb->data, pb->len);
+        pb->len = 0;
+    }
+    if (len + 32 > sizeof(pb->data))
+    {
+        printf("%12" PRIu64 " %.*s\n", count, (int)len, (const char *)word);
+        return;
+    }
+
+    pb->len += (size_t)snprintf(pb->data + pb->len, sizeof(pb->data) - pb->len, "%12" PRIu64 " ", count);
+    memcpy(pb->data + pb->len, word, len);
+    pb->len += len;
+    pb->data[pb->len++] = '\n';
+}
+
+static void print_flush(struct print_buf *pb)
+{
+    write_all(STDOUT_FILENO, pb->data, pb->len);
+    pb->len = 0;
+}
+
+/* Read one { count, len } record and its key, growing *word as needed */
+static int read_record(int fd, struct freq_record *r, unsigned char **word, size_t *cap)
+{
+    if (read_all(fd, r, sizeof(*r)) != sizeof(*r))
+        return -1;
+    if (r->len > *cap)
+    {
+        *cap = r->len;
+        *word = realloc(*word, *cap);
+        if (!*word)
+            die_perror("realloc");
+    }
+    if (read_all(fd, *word, r->len) != r->len)
+        return -1;
+    return 0;
+}
+
+int freq_recv_print(int fd)
+{
+    struct freq_header h;
+    if (read_all(fd, &h, sizeof(h)) != sizeof(h) || h.magic != FREQ_MAGIC)
+        return -1;
+
+    printf("Process 1: %" PRIu64 " distinct words, %" PRIu64 " most frequent:\n", h.distinct, h.entries);
+
+    static struct print_buf pb;
+    unsigned char *word = NULL;
+    size_t cap = 0;
+    int rc = 0;
+
+    for (uint64_t i = 0; i < h.entries; i++)
+    {
+        struct freq_record r;
+        if (read_record(fd, &r, &word, &cap) != 0)
+        {
+            rc = -1;
+            break;
+        }
+        print_entry(&pb, r.count, word, r.len);
+    }
+
+    print_flush(&pb);
+    free(word);
+    return rc;
+}
+
+void freq_print(const struct freq_entry *e, size_t n, uint64_t distinct)
+{
+    printf("Process 1: %" PRIu64 " distinct words, %zu most frequent:\n", distinct, n);
+
+    static struct print_buf pb;
+    for (size_t i = 0; i < n; i++)
+        print_entry(&pb, e[i].count, e[i].key, e[i].len);
+    print_flush(&pb);
+}
+
+/* One input of freq_merge_print(): the record at the front of a stream */
+struct merge_input
+{
+    int fd;
+    uint64_t left; /* records not read yet */
+    int live;      /* cur holds a record */
+    struct freq_entry cur;
+    unsigned char *word;
+    size_t cap;
+};
+
+static int merge_advance(struct merge_input *in)
+{
+    in->live = 0;
+    if (in->left == 0)
+        return 0;
+
+    struct freq_record r;
+    if (read_record(in->fd, &r, &in->word, &in->cap) != 0)
+        return -1;
+
+    in->left--;
+    in->live = 1;
+    in->cur.count = r.count;
+    in->cur.len = r.len;
+    in->cur.key = in->word;
+    return 0;
+}
+
+int freq_merge_print(const int *fds, int n, size_t k)
+{
+    struct merge_input *in = calloc((size_t)n, sizeof(*in));
+    if (!in)
+        die_perror("calloc");
+
+    /* Partitions are disjoint, so distinct counts simply add up */
+    uint64_t distinct = 0, available = 0;
+    int rc = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        struct freq_header h;
+        if (read_all(fds[i], &h, sizeof(h)) != sizeof(h) || h.magic != FREQ_MAGIC)
+        {
+            rc = -1;
+            n = i;
+            break;
+        }
+        in[i].fd = fds[i];
+        in[i].left = h.entries;
+        distinct += h.distinct;
+        available += h.entries;
+    }
+
+    uint64_t want = (k == 0 || k > available) ? available : k;
+    if (rc == 0)
+        printf("Process 1: %" PRIu64 " distinct words, %" PRIu64 " most frequent:\n", distinct, want);
+
+    for (int i = 0; rc == 0 && i < n; i++)
+        if (merge_advance(&in[i]) != 0)
+            rc = -1;
+
+    /*
+     * Every stream is already in rank order, so the next line is always
+     * the best of the N fronts. N is the number of workers, so a linear
+     * scan is cheaper than keeping a heap in order.
+     */
+    static struct print_buf pb;
+    for (uint64_t printed = 0; rc == 0 && printed < want; printed++)
+    {
+        int best = -1;
+        for (int i = 0; i < n; i++)
+            if (in[i].live && (best < 0 || ranks_before(&in[i].cur, &in[best].cur)))
+                best = i;
+        if (best < 0)
+        {
+            rc = -1;
+            break;
+        }
+
+        print_entry(&pb, in[best].cur.count, in[best].cur.key, in[best].cur.len);
+        if (merge_advance(&in[best]) != 0)
+            rc = -1;
+    }
+
+    print_flush(&pb);
+    for (int i = 0; i < n; i++)
+        free(in[i].word);
+    free(in);
+    return rc;
+}
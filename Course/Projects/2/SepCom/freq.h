@@ -0,0 +1,83 @@
+#ifndef FREQ_H
+#define FREQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Word frequency table for --freq.
+ *
+ * Keys are interned in a bump arena (big blocks, never freed one by one),
+ * and the table itself is open addressing with linear probing over a flat
+ * array of small slots. A lookup touches one or two cache lines, and
+ * growing the table only moves slots, never the key bytes.
+ */
+
+/* One slot: the full hash is kept so probing rarely needs to compare keys */
+struct freq_entry
+{
+    uint64_t hash;
+    const unsigned char *key; /* points into the arena, NULL = empty slot */
+    uint32_t len;
+    uint64_t count;
+};
+
+struct freq_arena_block; /* opaque, see freq.c */
+
+struct freq_table
+{
+    struct freq_entry *slots;
+    size_t capacity; /* power of two */
+    size_t used;     /* distinct words */
+    uint64_t total;  /* words inserted, duplicates included */
+    struct freq_arena_block *arena;
+};
+
+/* Fast 64-bit hash used for the table (and for sketches in other modules) */
+uint64_t freq_hash(const unsigned char *key, size_t len);
+
+void freq_init(struct freq_table *t);
+void freq_free(struct freq_table *t);
+
+/* Count one occurrence of key (n occurrences for freq_add_count) */
+void freq_add(struct freq_table *t, const unsigned char *key, size_t len);
+void freq_add_count(struct freq_table *t, const unsigned char *key, size_t len,
+                    uint64_t hash, uint64_t count);
+
+/*
+ * The k most frequent entries, most frequent first (ties broken by key so
+ * the output is deterministic). k == 0 means all entries.
+ * Selection uses a size-k min-heap, so the whole table is never sorted.
+ * Returns a malloc()ed array of *n_out entries that point into the table.
+ */
+struct freq_entry *freq_top(const struct freq_table *t, size_t k, size_t *n_out);
+
+/* Sort entries most frequent first, ties by key (same order as freq_top) */
+void freq_sort(struct freq_entry *e, size_t n);
+
+/*
+ * Wire format on pipe #2, right after the result message:
+ *   header { magic "PWCF", number of entries, distinct words in the table }
+ *   then per entry { count, len } followed by len key bytes.
+ * Process 1 prints entries as they arrive, so it never holds the table.
+ */
+void freq_send(int fd, const struct freq_entry *e, size_t n, uint64_t distinct);
+
+/*
+ * Read what freq_send() wrote and print it as "count word" lines.
+ * Returns 0 on success, -1 on a short or malformed message.
+ */
+int freq_recv_print(int fd);
+
+/* Same output straight from entries in memory (--threads has no pipe #2) */
+void freq_print(const struct freq_entry *e, size_t n, uint64_t distinct);
+
+/*
+ * Same output for -j N: fds[i] carries what worker i sent with
+ * freq_send(), each for a DISJOINT set of words and each in rank order.
+ * The streams are merged on the fly and printing stops after k lines
+ * (k == 0 means all), so Process 1 still never holds a table.
+ */
+int freq_merge_print(const int *fds, int n, size_t k);
+
+#endif
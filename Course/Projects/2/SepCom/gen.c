@@ -0,0 +1,491 @@
+/*
+ * gen.c: pwcgen, a synthetic corpus generator for pwordcount
+ *
+ * Writes SIZE bytes of deterministic text (same --seed, same bytes) and
+ * prints the counts pwordcount must report for it, so tests and the
+ * benchmark can check results at 10-100 GB without a reference tool:
+ *
+ *   ./pwcgen --size=10G --seed=7 --output=big.txt
+ *   lines=... words=... bytes=... chars=... max_line=...     (on stderr)
+ *
+ * Speed: a table of GEN_TOKENS tokens ("word + separator") is built from
+ * the seed first. The output is then a random walk over that table, one
+ * 16-bit index per token, copied into a 1 MiB buffer that is written and
+ * reused, so memory stays constant and the loop is mostly memcpy().
+ * Line breaks are inserted between tokens when the line reaches its
+ * (random) target length, or before a token that would take it past the
+ * --line-len maximum.
+ *
+ * Knobs (the table's make-up follows them, so their shares are exact on
+ * average and very close on any large output):
+ *   --word-len=MIN-MAX      characters per word (1..64, default 1-12)
+ *   --word-dist=uniform|english   flat lengths, or English-like (most words 2-5)
+ *   --tabs=P  --runs=P      share of separators that are a tab, or a run of
+ *                           2-32 spaces/tabs; the rest are single spaces
+ *   --crlf=P                share of line ends written as "\r\n"
+ *   --utf8=P                share of words written with 2- and 3-byte UTF-8
+ *                           letters (Latin-1, Cyrillic, CJK). No Unicode
+ *                           whitespace is generated, so the word count is the
+ *                           same with and without pwordcount --utf8.
+ *   --line-len=MIN-MAX      characters per line (default 40-120); only a word
+ *                           longer than MAX makes a longer line, on its own.
+ *                           The last line may be shorter than MIN.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "ioutil.h"
+
+#define GEN_TOKENS 65536
+#define GEN_MAX_WORD 64
+#define GEN_MAX_RUN 32
+/* Longest token: a word of 3-byte letters plus the longest run */
+#define GEN_MAX_TOKEN (GEN_MAX_WORD * 3 + GEN_MAX_RUN)
+#define GEN_BUF_SIZE (1024 * 1024)
+/* Tokens are copied GEN_COPY bytes at a time (fixed-size memcpy() compiles to two moves) */
+#define GEN_COPY 32
+
+struct gen_options
+{
+    uint64_t size;
+    uint64_t seed;
+    unsigned word_min, word_max;
+    int english;
+    double tabs, runs, crlf, utf8;
+    unsigned line_min, line_max;
+    const char *output;
+};
+
+/* The token table: all bytes back to back, plus per-token offsets */
+struct token_table
+{
+    unsigned char *bytes;
+    uint32_t offset[GEN_TOKENS + 1];
+    uint16_t chars[GEN_TOKENS]; /* characters, separator included */
+};
+
+/* English word lengths 1..15, in parts per thousand (roughly) */
+static const unsigned english_lengths[15] = { 30, 170, 210, 160, 110, 85, 75, 55, 40, 25, 15, 10, 7, 5, 3 };
+
+static uint64_t xorshift64(uint64_t *s)
+{
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+/* Uniform double in [0, 1) */
+static double uniform01(uint64_t *s)
+{
+    return (double)(xorshift64(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static unsigned range(uint64_t *s, unsigned lo, unsigned hi)
+{
+    return lo + (unsigned)(xorshift64(s) % (hi - lo + 1));
+}
+
+static unsigned pick_word_len(const struct gen_options *g, uint64_t *s)
+{
+    if (!g->english)
+        return range(s, g->word_min, g->word_max);
+
+    /* Draw from the English table, restricted to [word_min, word_max] */
+    unsigned total = 0;
+    for (unsigned len = g->word_min; len <= g->word_max; len++)
+        total += len <= 15 ? english_lengths[len - 1] : 1;
+    unsigned r = (unsigned)(xorshift64(s) % total);
+    for (unsigned len = g->word_min; len <= g->word_max; len++)
+    {
+        unsigned w = len <= 15 ? english_lengths[len - 1] : 1;
+        if (r < w)
+            return len;
+        r -= w;
+    }
+    return g->word_max;
+}
+
+/* One UTF-8 letter of `width` bytes (2 or 3); none of them is whitespace */
+static size_t put_utf8_letter(unsigned char *p, unsigned width, uint64_t *s)
+{
+    uint32_t cp;
+    if (width == 2)
+        cp = (xorshift64(s) & 1) ? 0x00E0 + (uint32_t)(xorshift64(s) % 32)  /* à..ÿ */
+                                 : 0x0430 + (uint32_t)(xorshift64(s) % 32); /* а..я */
+    else
+        cp = 0x4E00 + (uint32_t)(xorshift64(s) % 0x5000);                   /* CJK */
+
+    if (width == 2)
+    {
+        p[0] = (unsigned char)(0xC0 | (cp >> 6));
+        p[1] = (unsigned char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    p[0] = (unsigned char)(0xE0 | (cp >> 12));
+    p[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+    p[2] = (unsigned char)(0x80 | (cp & 0x3F));
+    return 3;
+}
+
+static void build_tokens(const struct gen_options *g, struct token_table *t, uint64_t *s)
+{
+    /* + GEN_COPY: the output loop may copy past the last token */
+    t->bytes = malloc((size_t)GEN_TOKENS * GEN_MAX_TOKEN + GEN_COPY);
+    if (!t->bytes)
+        die_perror("malloc");
+
+    uint32_t off = 0;
+    for (unsigned i = 0; i < GEN_TOKENS; i++)
+    {
+        unsigned char *p = t->bytes + off;
+        size_t n = 0;
+        unsigned chars = 0;
+
+        unsigned len = pick_word_len(g, s);
+        unsigned width = uniform01(s) < g->utf8 ? range(s, 2, 3) : 1;
+        for (unsigned k = 0; k < len; k++)
+        {
+            if (width == 1)
+                p[n++] = (unsigned char)('a' + xorshift64(s) % 26);
+            else
+                n += put_utf8_letter(p + n, width, s);
+        }
+        chars += len;
+
+        double r = uniform01(s);
+        if (r < g->runs)
+        {
+            unsigned run = range(s, 2, GEN_MAX_RUN);
+            for (unsigned k = 0; k < run; k++)
+                p[n++] = (xorshift64(s) & 3) ? ' ' : '\t';
+            chars += run;
+        }
+        else
+        {
+            p[n++] = r < g->runs + g->tabs ? '\t' : ' ';
+            chars++;
+        }
+
+        t->offset[i] = off;
+        t->chars[i] = (uint16_t)chars;
+        off += (uint32_t)n;
+    }
+    t->offset[GEN_TOKENS] = off;
+}
+
+/* Expected pwordcount results, kept while generating */
+struct expected
+{
+    uint64_t lines, words, bytes, chars, max_line;
+    uint64_t line_len; /* characters in the current line */
+};
+
+static void end_line(struct expected *e)
+{
+    if (e->line_len > e->max_line)
+        e->max_line = e->line_len;
+    e->line_len = 0;
+    e->lines++;
+}
+
+static void generate(const struct gen_options *g, int fd, struct expected *e)
+{
+    uint64_t s = g->seed * 0x9e3779b97f4a7c15ull + 0x2545f4914f6cdd1dull;
+    if (s == 0)
+        s = 1; /* xorshift must not start at 0 */
+
+    struct token_table *t = malloc(sizeof(*t));
+    if (!t)
+        die_perror("malloc");
+    build_tokens(g, t, &s);
+
+    unsigned char *buf = malloc(GEN_BUF_SIZE);
+    if (!buf)
+        die_perror("malloc");
+
+    memset(e, 0, sizeof(*e));
+    unsigned target = range(&s, g->line_min, g->line_max);
+    size_t used = 0;
+    uint64_t indices = 0;
+    int left = 0;
+
+    /*
+     * Full tokens while a token and a line end surely fit in what is left.
+     * The counters live in locals: every store into buf may alias *e and
+     * would otherwise force them back to memory on each token.
+     */
+    uint64_t bytes = 0, words = 0, chars = 0, line_len = 0;
+    while (g->size - bytes >= GEN_MAX_TOKEN + 2)
+    {
+        if (used + GEN_MAX_TOKEN + GEN_COPY + 2 > GEN_BUF_SIZE)
+        {
+            write_all(fd, buf, used);
+            used = 0;
+        }
+
+        /* Four 16-bit token indices per random number */
+        if (left == 0)
+        {
+            indices = xorshift64(&s);
+            left = 4;
+        }
+        unsigned i = (unsigned)(indices & 0xffff);
+        indices >>= 16;
+        left--;
+
+        /* End the line once it reached its target, or before this token would take it past --line-len */
+        if (line_len > 0 && (line_len >= target || line_len + t->chars[i] > g->line_max))
+        {
+            if (g->crlf > 0 && uniform01(&s) < g->crlf && line_len < g->line_max)
+            {
+                buf[used++] = '\r';
+                bytes++;
+                chars++;
+                line_len++; /* '\r' is a character of the line */
+            }
+            buf[used++] = '\n';
+            bytes++;
+            chars++;
+            e->line_len = line_len;
+            end_line(e);
+            line_len = 0;
+            target = range(&s, g->line_min, g->line_max);
+        }
+
+        const unsigned char *src = t->bytes + t->offset[i];
+        uint32_t n = t->offset[i + 1] - t->offset[i];
+        memcpy(buf + used, src, GEN_COPY);
+        for (uint32_t k = GEN_COPY; k < n; k += GEN_COPY)
+            memcpy(buf + used + k, src + k, GEN_COPY);
+        used += n;
+        bytes += n;
+        words++;
+        chars += t->chars[i];
+        line_len += t->chars[i];
+    }
+    e->bytes = bytes;
+    e->words = words;
+    e->chars = chars;
+    e->line_len = line_len;
+
+    /*
+     * Fill the exact size with words of the --word-len range and line breaks
+     * at the --line-len targets, ending in a '\n'. When what is left is too
+     * short for another word, spaces (or, at the end of a full line, empty
+     * lines) take up the rest.
+     */
+    uint64_t rest = g->size - e->bytes;
+    if (used + rest > GEN_BUF_SIZE)
+    {
+        write_all(fd, buf, used);
+        used = 0;
+    }
+    while (rest > 1)
+    {
+        unsigned fit = rest - 1 < g->word_max ? (unsigned)(rest - 1) : g->word_max;
+        if (e->line_len > 0 && (e->line_len >= target || e->line_len + g->word_min > g->line_max))
+        {
+            buf[used++] = '\n';
+            e->chars++;
+            end_line(e);
+            target = range(&s, g->line_min, g->line_max);
+        }
+        else if (fit >= g->word_min && e->line_len + g->word_min <= g->line_max)
+        {
+            unsigned len = pick_word_len(g, &s);
+            if (len > fit)
+                len = fit;
+            if (e->line_len + len > g->line_max)
+                len = (unsigned)(g->line_max - e->line_len);
+            for (unsigned k = 0; k < len; k++)
+                buf[used++] = (unsigned char)('a' + xorshift64(&s) % 26);
+            e->words++;
+            e->chars += len;
+            e->line_len += len;
+            rest -= len;
+            if (rest > 1 && e->line_len < target && e->line_len < g->line_max)
+            {
+                buf[used++] = ' ';
+                e->chars++;
+                e->line_len++;
+                rest--;
+            }
+            continue;
+        }
+        else if (e->line_len < g->line_max)
+        {
+            buf[used++] = ' ';
+            e->chars++;
+            e->line_len++;
+        }
+        else
+        {
+            buf[used++] = '\n';
+            e->chars++;
+            end_line(e);
+        }
+        rest--;
+    }
+    if (rest == 1)
+    {
+        buf[used++] = '\n';
+        e->chars++;
+        end_line(e);
+    }
+    else if (e->line_len > e->max_line)
+    {
+        e->max_line = e->line_len; /* tiny --size: the partial line still counts */
+    }
+    e->bytes = g->size;
+    write_all(fd, buf, used);
+
+    free(buf);
+    free(t->bytes);
+    free(t);
+}
+
+/* ---------- command line ---------- */
+
+static void print_usage(void)
+{
+    printf("Usage: ./pwcgen --size=SIZE [--seed=N] [--output=FILE]\n"
+           "               [--word-len=MIN-MAX] [--word-dist=uniform|english]\n"
+           "               [--tabs=P] [--runs=P] [--crlf=P] [--utf8=P] [--line-len=MIN-MAX]\n"
+           "Writes the text to FILE (default stdout) and the expected counts to stderr.\n");
+}
+
+static int parse_ratio(const char *text, double *out)
+{
+    char *end;
+    double v = strtod(text, &end);
+    if (*text == '\0' || *end != '\0' || !(v >= 0.0 && v <= 1.0))
+        return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_range(const char *text, unsigned lo_limit, unsigned hi_limit, unsigned *lo, unsigned *hi)
+{
+    char *end;
+    unsigned long a = strtoul(text, &end, 10);
+    if (end == text || *end != '-')
+        return -1;
+    const char *second = end + 1;
+    unsigned long b = strtoul(second, &end, 10);
+    if (end == second || *end != '\0' || a < lo_limit || b > hi_limit || a > b)
+        return -1;
+    *lo = (unsigned)a;
+    *hi = (unsigned)b;
+    return 0;
+}
+
+static int parse_args(int argc, char *argv[], struct gen_options *g)
+{
+    memset(g, 0, sizeof(*g));
+    g->seed = 1;
+    g->word_min = 1;
+    g->word_max = 12;
+    g->tabs = 0.05;
+    g->runs = 0.01;
+    g->line_min = 40;
+    g->line_max = 120;
+
+    int have_size = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        int bad = 0;
+
+        if (strncmp(arg, "--size=", 7) == 0)
+        {
+            size_t size;
+            bad = parse_size(arg + 7, &size) < 0;
+            g->size = size;
+            have_size = 1;
+        }
+        else if (strncmp(arg, "--seed=", 7) == 0)
+        {
+            char *end;
+            g->seed = strtoull(arg + 7, &end, 10);
+            bad = arg[7] == '\0' || *end != '\0';
+        }
+        else if (strncmp(arg, "--output=", 9) == 0 && arg[9] != '\0')
+            g->output = arg + 9;
+        else if (strncmp(arg, "--word-len=", 11) == 0)
+            bad = parse_range(arg + 11, 1, GEN_MAX_WORD, &g->word_min, &g->word_max) < 0;
+        else if (strcmp(arg, "--word-dist=uniform") == 0)
+            g->english = 0;
+        else if (strcmp(arg, "--word-dist=english") == 0)
+            g->english = 1;
+        else if (strncmp(arg, "--tabs=", 7) == 0)
+            bad = parse_ratio(arg + 7, &g->tabs) < 0;
+        else if (strncmp(arg, "--runs=", 7) == 0)
+            bad = parse_ratio(arg + 7, &g->runs) < 0;
+        else if (strncmp(arg, "--crlf=", 7) == 0)
+            bad = parse_ratio(arg + 7, &g->crlf) < 0;
+        else if (strncmp(arg, "--utf8=", 7) == 0)
+            bad = parse_ratio(arg + 7, &g->utf8) < 0;
+        else if (strncmp(arg, "--line-len=", 11) == 0)
+            bad = parse_range(arg + 11, 1, 1000000, &g->line_min, &g->line_max) < 0;
+        else
+            bad = 1;
+
+        if (bad)
+        {
+            fprintf(stderr, "Error: invalid argument \"%s\".\n", arg);
+            return -1;
+        }
+    }
+
+    if (!have_size)
+    {
+        fprintf(stderr, "Error: --size is required.\n");
+        return -1;
+    }
+    if (g->tabs + g->runs > 1.0)
+    {
+        fprintf(stderr, "Error: --tabs and --runs add up to more than 1.\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct gen_options g;
+    if (parse_args(argc, argv, &g) < 0)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    int fd = STDOUT_FILENO;
+    if (g.output)
+    {
+        fd = open(g.output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            fprintf(stderr, "Error: cannot create file \"%s\": %s\n", g.output, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct expected e;
+    generate(&g, fd, &e);
+
+    if (g.output && close(fd) < 0)
+        die_perror("close");
+
+    /* One machine-readable line; the same metrics as pwordcount -l -w -c -m -L */
+    fprintf(stderr, "lines=%" PRIu64 " words=%" PRIu64 " bytes=%" PRIu64 " chars=%" PRIu64 " max_line=%" PRIu64 "\n",
+            e.lines, e.words, e.bytes, e.chars, e.max_line);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,55 @@
+#ifndef HLL_H
+#define HLL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * HyperLogLog sketch for --distinct: an ESTIMATE of the number of distinct
+ * words in a fixed amount of memory.
+ *
+ * The top p bits of a word's 64-bit hash pick one of m = 2^p registers, and
+ * the register remembers the longest run of leading zeros seen in the
+ * remaining bits. Many distinct words => some hash with a long run.
+ * Memory is m bytes whatever the input size (4 KiB at the default p = 12),
+ * and the standard error is about 1.04 / sqrt(m) (1.6% at p = 12).
+ *
+ * Two sketches with the same precision merge by taking the register-wise
+ * maximum, so per-worker sketches combine exactly into the sketch of the
+ * whole input, in any order.
+ */
+#define HLL_MIN_PRECISION 4
+#define HLL_MAX_PRECISION 16
+#define HLL_DEFAULT_PRECISION 12
+
+struct hll
+{
+    unsigned precision;
+    uint8_t *registers; /* 2^precision bytes */
+};
+
+/* Returns 0, or -1 if precision is outside [HLL_MIN_PRECISION, HLL_MAX_PRECISION] */
+int hll_init(struct hll *h, unsigned precision);
+void hll_free(struct hll *h);
+
+/* Add one word by its freq_hash() (freq.h); duplicates change nothing */
+void hll_add_hash(struct hll *h, uint64_t hash);
+
+/* dst |= src. Returns -1 if the precisions differ. */
+int hll_merge(struct hll *dst, const struct hll *src);
+
+/* Estimated number of distinct words added (with the small-range correction) */
+double hll_estimate(const struct hll *h);
+
+/*
+ * Wire format on pipe #2: header { magic "PWCH", precision } then the
+ * 2^precision registers. hll_recv() initialises h; returns -1 on a short
+ * or malformed message.
+ */
+void hll_send(int fd, const struct hll *h);
+int hll_recv(int fd, struct hll *h);
+
+/* "Process 1: About N distinct words ..." */
+void hll_print(const struct hll *h);
+
+#endif
@@ -0,0 +1,113 @@
+#include "ioutil.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* Print system error message and exit */
+void die_perror(const char *msg)
+{
+    perror(msg);
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * write_all:
+ * Pipes do NOT guarantee that write(fd, buf, n) writes all n bytes in one call.
+ * This function keeps writing until every byte is sent (or a real error happens).
+ */
+void write_all(int fd, const void *buf, size_t n)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    size_t sent = 0;
+
+    while (sent < n)
+    {
+        ssize_t w = write(fd, p + sent, n - sent);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+            {
+                if (pwc_stats_active)
+                    pwc_stats_active->eintr++;
+                continue; /* interrupted: try again */
+            }
+            die_perror("write");
+        }
+        if ((size_t)w < n - sent && pwc_stats_active)
+            pwc_stats_active->short_writes++;
+        sent += (size_t)w;
+    }
+}
+
+/*
+ * read_all:
+ * Reads up to n bytes unless EOF occurs first.
+ * We mainly use it to safely read the final result from pipe2.
+ */
+size_t read_all(int fd, void *buf, size_t n)
+{
+    unsigned char *p = (unsigned char *)buf;
+    size_t total = 0;
+
+    while (total < n)
+    {
+        ssize_t r = read(fd, p + total, n - total);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+            {
+                if (pwc_stats_active)
+                    pwc_stats_active->eintr++;
+                continue; /* interrupted: try again */
+            }
+            die_perror("read");
+        }
+        if (r == 0)
+            break; /* EOF */
+        total += (size_t)r;
+    }
+
+    return total;
+}
+
+int parse_size(const char *text, size_t *out)
+{
+    char *end;
+
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || text[0] == '-')
+        return -1;
+
+    /* Optional K/M/G suffix, powers of 1024 like the kernel's pipe sizes */
+    unsigned shift = 0;
+    switch (*end)
+    {
+    case 'k':
+    case 'K':
+        shift = 10;
+        end++;
+        break;
+    case 'm':
+    case 'M':
+        shift = 20;
+        end++;
+        break;
+    case 'g':
+    case 'G':
+        shift = 30;
+        end++;
+        break;
+    default:
+        break;
+    }
+
+    if (*end != '\0' || v > ((unsigned long long)(size_t)-1 >> shift))
+        return -1;
+
+    *out = (size_t)(v << shift);
+    return 0;
+}
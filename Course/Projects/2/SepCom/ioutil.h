@@ -0,0 +1,30 @@
+#ifndef IOUTIL_H
+#define IOUTIL_H
+
+#include <stddef.h>
+
+#define READ_END 0
+#define WRITE_END 1
+
+/* Print system error message (perror style) and exit */
+void die_perror(const char *msg);
+
+/*
+ * Write all n bytes to fd, retrying on short writes and EINTR.
+ * Exits the process on a real error.
+ */
+void write_all(int fd, const void *buf, size_t n);
+
+/*
+ * Read up to n bytes from fd unless EOF occurs first.
+ * Returns how many bytes were read. Exits the process on a real error.
+ */
+size_t read_all(int fd, void *buf, size_t n);
+
+/*
+ * Parse a byte size such as "4096", "64K", "1M" or "2G" (binary units).
+ * Returns 0 and stores the value on success, -1 if the text is not a size.
+ */
+int parse_size(const char *text, size_t *out);
+
+#endif
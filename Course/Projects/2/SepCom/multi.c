@@ -0,0 +1,414 @@
+/*
+ * multi.c: counting many files (and directories) in one run
+ *
+ * "./pwordcount a.log b.log logs/" walks every directory (entries in name
+ * order, so the output order never changes), then counts all regular files
+ * with a fixed pool of threads instead of one fork() + two pipes per file.
+ *
+ * Work is split into tasks: a small file is one task, a big file is cut
+ * into MULTI_SPLIT-byte ranges so one huge log cannot keep a single
+ * thread busy while the others sit idle. Each thread owns a work-stealing
+ * deque (wsdeque.h); when its own deque runs dry it steals from the others.
+ *
+ * A range is counted into a struct wc_summary exactly like a -j range
+ * (parallel.c), and the ranges of a file are folded with wc_combine() in
+ * file order, so the per-file counts are exact. Files are independent, so
+ * the total simply adds them up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "pwordcount.h"
+#include "wordcount.h"
+#include "ioutil.h"
+#include "result.h"
+#include "wsdeque.h"
+
+/* Files bigger than this are split into several tasks */
+#define MULTI_SPLIT (16 * 1024 * 1024)
+
+/* pread() size inside a task when no --chunk is given */
+#define MULTI_CHUNK (256 * 1024)
+
+struct mfile
+{
+    char *path;
+    off_t size;
+    size_t first_task;
+    size_t ntasks;
+};
+
+struct mtask
+{
+    size_t file;
+    off_t start, end;
+    struct wc_summary result;
+    int error; /* errno of a failed open()/pread(), 0 = ok */
+};
+
+struct pool
+{
+    const struct options *opt;
+    struct mfile *files;
+    size_t nfiles, files_cap;
+    struct mtask *tasks;
+    size_t ntasks;
+    struct wsdeque *deques;
+    int nworkers;
+    size_t chunk;
+    int walk_failed;
+};
+
+struct worker
+{
+    struct pool *pool;
+    int id;
+    uint64_t stolen;
+};
+
+/* ---------- walking the command line ---------- */
+
+static void add_file(struct pool *p, const char *path, off_t size)
+{
+    if (p->nfiles == p->files_cap)
+    {
+        p->files_cap = p->files_cap ? p->files_cap * 2 : 64;
+        p->files = realloc(p->files, p->files_cap * sizeof(*p->files));
+        if (!p->files)
+            die_perror("realloc");
+    }
+
+    struct mfile *f = &p->files[p->nfiles++];
+    memset(f, 0, sizeof(*f));
+    f->path = strdup(path);
+    if (!f->path)
+        die_perror("strdup");
+    f->size = size;
+}
+
+static void add_path(struct pool *p, const char *path, int top_level);
+
+static void add_directory(struct pool *p, const char *path)
+{
+    struct dirent **names;
+    int n = scandir(path, &names, NULL, alphasort);
+    if (n < 0)
+    {
+        fprintf(stderr, "Error: cannot read directory \"%s\": %s\n", path, strerror(errno));
+        p->walk_failed = 1;
+        return;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        const char *name = names[i]->d_name;
+        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0)
+        {
+            size_t len = strlen(path);
+            char *child = malloc(len + strlen(name) + 2);
+            if (!child)
+                die_perror("malloc");
+            sprintf(child, "%s%s%s", path, (len > 0 && path[len - 1] == '/') ? "" : "/", name);
+            add_path(p, child, 0);
+            free(child);
+        }
+        free(names[i]);
+    }
+    free(names);
+}
+
+/*
+ * Paths named on the command line are followed if they are symlinks.
+ * Inside a directory, a symlink to a file is counted but a symlink to a
+ * directory is not entered (it could loop back to where we came from).
+ */
+static void add_path(struct pool *p, const char *path, int top_level)
+{
+    struct stat st;
+    if ((top_level ? stat(path, &st) : lstat(path, &st)) < 0)
+    {
+        fprintf(stderr, "Error: cannot stat \"%s\": %s\n", path, strerror(errno));
+        p->walk_failed = 1;
+        return;
+    }
+
+    if (!top_level && S_ISLNK(st.st_mode))
+    {
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+            return;
+    }
+
+    if (S_ISDIR(st.st_mode))
+        add_directory(p, path);
+    else if (S_ISREG(st.st_mode))
+        add_file(p, path, st.st_size);
+    else if (top_level)
+    {
+        fprintf(stderr, "Error: \"%s\" is not a regular file or directory.\n", path);
+        p->walk_failed = 1;
+    }
+}
+
+/* ---------- tasks ---------- */
+
+static void make_tasks(struct pool *p)
+{
+    for (size_t i = 0; i < p->nfiles; i++)
+    {
+        off_t size = p->files[i].size;
+        p->files[i].first_task = p->ntasks;
+        p->files[i].ntasks = size > MULTI_SPLIT ? (size_t)((size + MULTI_SPLIT - 1) / MULTI_SPLIT) : 1;
+        p->ntasks += p->files[i].ntasks;
+    }
+
+    p->tasks = calloc(p->ntasks ? p->ntasks : 1, sizeof(*p->tasks));
+    if (!p->tasks)
+        die_perror("calloc");
+
+    for (size_t i = 0; i < p->nfiles; i++)
+    {
+        for (size_t k = 0; k < p->files[i].ntasks; k++)
+        {
+            struct mtask *t = &p->tasks[p->files[i].first_task + k];
+            t->file = i;
+            t->start = (off_t)k * MULTI_SPLIT;
+            t->end = (k + 1 == p->files[i].ntasks) ? p->files[i].size : (off_t)(k + 1) * MULTI_SPLIT;
+        }
+    }
+}
+
+/* With --utf8, move a range boundary past continuation bytes (as in parallel.c) */
+static off_t sync_boundary(int fd, off_t pos, off_t size)
+{
+    if (pos <= 0 || pos >= size)
+        return pos;
+
+    unsigned char b[3];
+    ssize_t r;
+    do
+        r = pread(fd, b, size - pos < 3 ? (size_t)(size - pos) : 3, pos);
+    while (r < 0 && errno == EINTR);
+    if (r <= 0)
+        return pos;
+    return pos + (off_t)wc_utf8_sync(b, (size_t)r);
+}
+
+static void run_task(struct pool *p, struct mtask *t, unsigned char *buf)
+{
+    const struct mfile *f = &p->files[t->file];
+    unsigned metrics = p->opt->metrics;
+
+    struct wc_stream stream;
+    wc_stream_init(&stream, metrics);
+
+    int fd = open(f->path, O_RDONLY);
+    if (fd < 0)
+    {
+        t->error = errno;
+        return;
+    }
+
+    off_t start = t->start, end = t->end;
+    if (metrics & WC_UTF8)
+    {
+        start = sync_boundary(fd, start, f->size);
+        end = sync_boundary(fd, end, f->size);
+    }
+
+    while (start < end)
+    {
+        size_t want = (off_t)p->chunk < end - start ? p->chunk : (size_t)(end - start);
+        ssize_t r = pread(fd, buf, want, start);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            t->error = errno;
+            break;
+        }
+        if (r == 0)
+            break; /* file shrank since we listed it: count what is there */
+
+        wc_stream_feed(&stream, buf, (size_t)r);
+        start += r;
+    }
+
+    close(fd);
+    t->result = wc_stream_finish(&stream);
+}
+
+/* ---------- the pool ---------- */
+
+static int64_t find_task(struct worker *w)
+{
+    struct pool *p = w->pool;
+
+    int64_t task = wsdeque_pop(&p->deques[w->id]);
+    if (task != WSDEQUE_EMPTY)
+        return task;
+
+    /*
+     * Steal, starting with our right-hand neighbour so thieves spread out.
+     * No task is ever created after the start, so once every deque is seen
+     * empty (no lost races) there is nothing left for us to do.
+     */
+    while (1)
+    {
+        int aborted = 0;
+        for (int k = 1; k < p->nworkers; k++)
+        {
+            int victim = (w->id + k) % p->nworkers;
+            task = wsdeque_steal(&p->deques[victim]);
+            if (task >= 0)
+            {
+                w->stolen++;
+                return task;
+            }
+            if (task == WSDEQUE_ABORT)
+                aborted = 1;
+        }
+        if (!aborted)
+            return WSDEQUE_EMPTY;
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct pool *p = w->pool;
+
+    unsigned char *buf = malloc(p->chunk);
+    if (!buf)
+        die_perror("malloc");
+
+    int64_t task;
+    while ((task = find_task(w)) != WSDEQUE_EMPTY)
+        run_task(p, &p->tasks[task], buf);
+
+    free(buf);
+    return NULL;
+}
+
+static void add_counts(struct wc_counts *total, const struct wc_counts *c)
+{
+    total->lines += c->lines;
+    total->words += c->words;
+    total->bytes += c->bytes;
+    total->chars += c->chars;
+    if (c->max_line > total->max_line)
+        total->max_line = c->max_line;
+}
+
+int run_multi_mode(const struct options *opt)
+{
+    struct pool p;
+    memset(&p, 0, sizeof(p));
+    p.opt = opt;
+    p.chunk = opt->chunk ? opt->chunk : MULTI_CHUNK;
+
+    for (int i = 0; i < opt->npaths; i++)
+        add_path(&p, opt->paths[i], 1);
+    make_tasks(&p);
+
+    /* -j N sets the pool size (0 = not given: one thread per online CPU) */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    p.nworkers = opt->jobs >= 1 ? opt->jobs : (cpus > 0 ? (int)cpus : 1);
+    if ((size_t)p.nworkers > p.ntasks)
+        p.nworkers = p.ntasks > 0 ? (int)p.ntasks : 1;
+
+    printf("Process 1 counts %zu files (%zu tasks) with %d worker threads ...\n",
+           p.nfiles, p.ntasks, p.nworkers);
+
+    /*
+     * Deal the tasks out round-robin. Each deque gets its share in reverse,
+     * so its owner (popping at the bottom) works front to back, while
+     * thieves (taking from the top) start at the far end.
+     */
+    p.deques = calloc((size_t)p.nworkers, sizeof(*p.deques));
+    struct worker *workers = calloc((size_t)p.nworkers, sizeof(*workers));
+    pthread_t *threads = calloc((size_t)p.nworkers, sizeof(*threads));
+    if (!p.deques || !workers || !threads)
+        die_perror("calloc");
+
+    for (int i = 0; i < p.nworkers; i++)
+        wsdeque_init(&p.deques[i], p.ntasks / (size_t)p.nworkers + 1);
+    for (size_t t = p.ntasks; t-- > 0;)
+        wsdeque_push(&p.deques[t % (size_t)p.nworkers], (int64_t)t);
+
+    for (int i = 0; i < p.nworkers; i++)
+    {
+        workers[i].pool = &p;
+        workers[i].id = i;
+        int rc = pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+        if (rc != 0)
+        {
+            errno = rc;
+            die_perror("pthread_create");
+        }
+    }
+
+    uint64_t stolen = 0;
+    for (int i = 0; i < p.nworkers; i++)
+    {
+        pthread_join(threads[i], NULL);
+        stolen += workers[i].stolen;
+    }
+
+    printf("Process 1 finished; idle workers stole %llu of %zu tasks.\n",
+           (unsigned long long)stolen, p.ntasks);
+
+    /* Report in the order the files were listed */
+    unsigned metrics = opt->metrics & WC_ALL;
+    struct wc_counts total;
+    memset(&total, 0, sizeof(total));
+    int failed = p.walk_failed;
+
+    for (size_t i = 0; i < p.nfiles; i++)
+    {
+        const struct mfile *f = &p.files[i];
+        struct wc_summary sum;
+        memset(&sum, 0, sizeof(sum));
+        int error = 0;
+
+        for (size_t k = 0; k < f->ntasks; k++)
+        {
+            const struct mtask *t = &p.tasks[f->first_task + k];
+            if (t->error && !error)
+                error = t->error;
+            sum = wc_combine(sum, t->result);
+        }
+
+        if (error)
+        {
+            fprintf(stderr, "Error: cannot read file \"%s\": %s\n", f->path, strerror(error));
+            failed = 1;
+            continue;
+        }
+
+        struct wc_counts c;
+        wc_summary_counts(&sum, &c);
+        print_counts_row(metrics, &c, f->path);
+        add_counts(&total, &c);
+    }
+    print_counts_row(metrics, &total, "total");
+
+    for (int i = 0; i < p.nworkers; i++)
+        wsdeque_free(&p.deques[i]);
+    for (size_t i = 0; i < p.nfiles; i++)
+        free(p.files[i].path);
+    free(p.deques);
+    free(workers);
+    free(threads);
+    free(p.tasks);
+    free(p.files);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,438 @@
+/*
+ * parallel.c: the "-j N" fan-out mode of pwordcount
+ *
+ * Instead of ONE Process 2, Process 1 forks N counting processes:
+ *
+ *                 +--> worker 0: bytes [0, s1)   --pipe--+
+ *   Process 1 ----+--> worker 1: bytes [s1, s2)  --pipe--+--> Process 1 merges
+ *                 +--> worker N-1: [s(N-1), end) --pipe--+
+ *
+ * Each worker reads its own range with pread() (or scans the shared mapping
+ * with --mmap), so no file bytes cross a pipe and no worker waits for another.
+ *
+ * The tricky part (same problem as chunks in wordcount.c, just in parallel):
+ *   a word may straddle a range boundary, e.g. "fr" | "iend".
+ *   Both workers see a word start there, so it would be counted twice.
+ *   Each worker therefore sends back a struct wc_summary (wordcount.h), which
+ *   also says whether its range starts and ends inside a word, and Process 1
+ *   folds the summaries together in file order with wc_combine().
+ *
+ * With --freq every worker also builds a word table for its range (and with
+ * --distinct a HyperLogLog sketch, merged by Process 1). A word
+ * belongs to the range it STARTS in: a worker skips a word it joins halfway
+ * and reads past its end to finish its own last word. The tables are then
+ * merged by hash partition without locks (pfreq.c), and each worker sends
+ * the top of its partition; Process 1 merges those sorted lists.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+
+#include "pwordcount.h"
+#include "wordcount.h"
+#include "ioutil.h"
+#include "result.h"
+#include "freq.h"
+#include "pfreq.h"
+#include "hll.h"
+#include "tokens.h"
+#include "cache.h"
+
+/* pread() size used by each worker when no --chunk is given */
+#define RANGE_CHUNK (256 * 1024)
+
+/*
+ * With --utf8 a range must not start in the middle of a character, or its
+ * first bytes would decode as garbage. Move a boundary forward past any
+ * continuation bytes; the neighbouring range computes the same position
+ * for its end, so every byte still belongs to exactly one range.
+ */
+static off_t sync_boundary(int fd, const unsigned char *map, off_t pos, off_t size)
+{
+    if (pos <= 0 || pos >= size)
+        return pos;
+
+    unsigned char b[3];
+    size_t n = size - pos < 3 ? (size_t)(size - pos) : 3;
+
+    if (map)
+    {
+        memcpy(b, map + pos, n);
+    }
+    else
+    {
+        ssize_t r;
+        do
+            r = pread(fd, b, n, pos);
+        while (r < 0 && errno == EINTR);
+        if (r <= 0)
+            return pos;
+        n = (size_t)r;
+    }
+
+    return pos + (off_t)wc_utf8_sync(b, n);
+}
+
+/* Read up to n bytes at pos from the mapping or the file; returns the count */
+static size_t read_at(int fd, const unsigned char *map, off_t size, unsigned char *buf, size_t n, off_t pos)
+{
+    if (pos >= size)
+        return 0;
+    if ((off_t)n > size - pos)
+        n = (size_t)(size - pos);
+
+    if (map)
+    {
+        memcpy(buf, map + pos, n);
+        return n;
+    }
+
+    ssize_t r;
+    do
+        r = pread(fd, buf, n, pos);
+    while (r < 0 && errno == EINTR);
+    if (r < 0)
+        die_perror("pread");
+    return (size_t)r;
+}
+
+/* --freq / --distinct state of one worker (tokens.h) plus its boundary rule */
+struct range_words
+{
+    struct token_counter tokens;
+    int skipping; /* still inside a word that started in the previous range */
+};
+
+static void range_words_init(struct range_words *rw, const struct options *opt,
+                             int fd, const unsigned char *map, off_t start, off_t size)
+{
+    token_counter_init(&rw->tokens, opt);
+
+    /* If the byte before us is part of a word, that word is not ours */
+    unsigned char before = ' ';
+    rw->skipping = start > 0 && read_at(fd, map, size, &before, 1, start - 1) == 1 && !wc_is_space(before);
+}
+
+static void range_words_feed(struct range_words *rw, const unsigned char *buf, size_t n)
+{
+    if (rw->skipping)
+    {
+        size_t j = 0;
+        while (j < n && !wc_is_space(buf[j]))
+            j++;
+        if (j == n)
+            return;
+        rw->skipping = 0;
+        buf += j;
+        n -= j;
+    }
+    token_counter_feed(&rw->tokens, buf, n);
+}
+
+/* Our last word may run past end: read on until it is complete */
+static void range_words_finish(struct range_words *rw, int fd, const unsigned char *map, off_t end, off_t size)
+{
+    unsigned char buf[4096];
+
+    while (rw->tokens.tok.carry_len > 0)
+    {
+        size_t n = read_at(fd, map, size, buf, sizeof(buf), end);
+        if (n == 0)
+            break;
+
+        size_t j = 0;
+        while (j < n && !wc_is_space(buf[j]))
+            j++;
+        token_counter_feed(&rw->tokens, buf, j);
+        if (j < n)
+            break;
+        end += (off_t)n;
+    }
+    token_counter_finish(&rw->tokens);
+}
+
+/*
+ * Count one byte range, either straight from the mapping or with pread().
+ * The range is fed to a wc_stream chunk by chunk, so the worker needs no
+ * state beyond the stream, and the result is a summary of the whole range.
+ * Exits the worker on a read error.
+ */
+static struct wc_summary count_range(int fd, const unsigned char *map, off_t start, off_t end,
+                                     size_t chunk, unsigned metrics, struct range_words *rw)
+{
+    struct wc_stream stream;
+    wc_stream_init(&stream, metrics);
+
+    /* Mapped ranges are walked in chunk-sized slices too, to stay in cache */
+    while (map && start < end)
+    {
+        size_t len = (off_t)chunk < end - start ? chunk : (size_t)(end - start);
+        wc_stream_feed(&stream, map + start, len);
+        if (rw)
+            range_words_feed(rw, map + start, len);
+        start += (off_t)len;
+    }
+    if (map)
+        return wc_stream_finish(&stream);
+
+    unsigned char *buf = malloc(chunk);
+    if (!buf)
+        die_perror("malloc");
+
+    off_t pos = start;
+    while (pos < end)
+    {
+        size_t want = chunk;
+        if ((off_t)want > end - pos)
+            want = (size_t)(end - pos);
+
+        ssize_t r = pread(fd, buf, want, pos);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            die_perror("pread");
+        }
+        if (r == 0)
+            break; /* file shrank underneath us: count what we saw */
+
+        wc_stream_feed(&stream, buf, (size_t)r);
+        if (rw)
+            range_words_feed(rw, buf, (size_t)r);
+        pos += r;
+    }
+
+    free(buf);
+    return wc_stream_finish(&stream);
+}
+
+int run_parallel_mode(const struct options *opt)
+{
+    const char *filename = opt->filename;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: cannot open file \"%s\": %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "Error: cannot stat file \"%s\": %s\n", filename, strerror(errno));
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    off_t size = st.st_size;
+
+    /* More workers than bytes would only produce empty ranges */
+    int jobs = opt->jobs;
+    if ((off_t)jobs > size)
+        jobs = size > 0 ? (int)size : 1;
+
+    /* With --mmap, map once here; every worker inherits the mapping */
+    const unsigned char *map = NULL;
+    if (opt->transport == TRANSPORT_MMAP && size > 0)
+    {
+        void *p = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            fprintf(stderr, "Error: cannot map file \"%s\": %s\n", filename, strerror(errno));
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        map = (const unsigned char *)p;
+    }
+
+    size_t chunk = opt->chunk ? opt->chunk : RANGE_CHUNK;
+
+    printf("Process 1 splits file \"%s\" into %d ranges ...\n", filename, jobs);
+
+    pid_t *pids = calloc((size_t)jobs, sizeof(*pids));
+    int *result_fds = calloc((size_t)jobs, sizeof(*result_fds));
+    if (!pids || !result_fds)
+        die_perror("calloc");
+
+    /* With --freq: one memfd per worker plus the barrier pipes, all inherited */
+    struct pfreq_exchange exchange;
+    if (opt->freq && pfreq_create(&exchange, jobs) < 0)
+        die_perror("pfreq_create");
+
+    for (int i = 0; i < jobs; i++)
+    {
+        int res_pipe[2]; /* worker i -> parent: its wc_summary */
+        if (pipe(res_pipe) == -1)
+            die_perror("pipe");
+
+        /* Split evenly; the last range absorbs the remainder */
+        off_t start = size / jobs * i;
+        off_t end = (i == jobs - 1) ? size : size / jobs * (i + 1);
+
+        pid_t pid = fork();
+        if (pid < 0)
+            die_perror("fork");
+
+        if (pid == 0)
+        {
+            /* =========================
+             * Worker i (Child)
+             * ========================= */
+            close(res_pipe[READ_END]);
+
+            /* Earlier workers' result pipes were inherited; we never use them */
+            for (int k = 0; k < i; k++)
+                close(result_fds[k]);
+
+            if (opt->metrics & WC_UTF8)
+            {
+                start = sync_boundary(fd, map, start, size);
+                end = sync_boundary(fd, map, end, size);
+            }
+
+            if (!opt->freq && !opt->distinct)
+            {
+                struct wc_summary res = count_range(fd, map, start, end, chunk, opt->metrics, NULL);
+                write_all(res_pipe[WRITE_END], &res, sizeof(res));
+                close(res_pipe[WRITE_END]);
+                _exit(EXIT_SUCCESS);
+            }
+
+            if (opt->freq)
+                pfreq_worker_setup(&exchange);
+
+            struct range_words rw;
+            range_words_init(&rw, opt, fd, map, start, size);
+            struct wc_summary res = count_range(fd, map, start, end, chunk, opt->metrics, &rw);
+            range_words_finish(&rw, fd, map, end, size);
+
+            /* Phase 1: publish our table, wait for the others */
+            if (opt->freq)
+            {
+                pfreq_worker_publish(&exchange, i, &rw.tokens.table);
+                freq_free(&rw.tokens.table);
+            }
+
+            /*
+             * Only now write to the result pipe: a big sketch could fill it,
+             * and Process 1 does not read it until everyone has published.
+             */
+            write_all(res_pipe[WRITE_END], &res, sizeof(res));
+            if (opt->distinct)
+            {
+                hll_send(res_pipe[WRITE_END], &rw.tokens.sketch);
+                hll_free(&rw.tokens.sketch);
+            }
+
+            /* Phase 2: own partition i of the vocabulary, send its top K */
+            if (opt->freq)
+            {
+                struct freq_table part;
+                freq_init(&part);
+                pfreq_worker_merge(&exchange, i, &part);
+
+                size_t n;
+                struct freq_entry *top = freq_top(&part, opt->top, &n);
+                freq_send(res_pipe[WRITE_END], top, n, part.used);
+                free(top);
+                freq_free(&part);
+            }
+
+            close(res_pipe[WRITE_END]);
+            _exit(EXIT_SUCCESS);
+        }
+
+        close(res_pipe[WRITE_END]);
+        pids[i] = pid;
+        result_fds[i] = res_pipe[READ_END];
+    }
+
+    printf("Process 1 is waiting for %d counting processes ...\n", jobs);
+
+    /* A worker that died before publishing would leave the others waiting forever */
+    int failed = 0;
+    if (opt->freq && pfreq_parent_sync(&exchange) < 0)
+    {
+        for (int i = 0; i < jobs; i++)
+            kill(pids[i], SIGTERM);
+        failed = 1;
+    }
+
+    /* Merge in file order; empty ranges are the identity of wc_combine() */
+    struct wc_summary total;
+    memset(&total, 0, sizeof(total));
+
+    for (int i = 0; i < jobs && !failed; i++)
+    {
+        struct wc_summary res;
+        if (read_all(result_fds[i], &res, sizeof(res)) != sizeof(res))
+        {
+            failed = 1;
+            continue;
+        }
+        total = wc_combine(total, res);
+    }
+
+    /* Sketches merge like summaries, but in any order */
+    struct hll sketch;
+    if (opt->distinct)
+        hll_init(&sketch, opt->distinct);
+
+    for (int i = 0; i < jobs && !failed && opt->distinct; i++)
+    {
+        struct hll part;
+        if (hll_recv(result_fds[i], &part) < 0 || hll_merge(&sketch, &part) < 0)
+            failed = 1;
+        hll_free(&part);
+    }
+
+    if (!failed)
+    {
+        struct wc_counts counts;
+        wc_summary_counts(&total, &counts);
+        print_counts(opt->metrics & WC_ALL, &counts);
+        result_cache_store(opt->cache, &counts);
+        if (opt->distinct)
+            hll_print(&sketch);
+    }
+    if (opt->distinct)
+        hll_free(&sketch);
+
+    int freq_failed = 0;
+    if (!failed && opt->freq && freq_merge_print(result_fds, jobs, opt->top) < 0)
+        freq_failed = 1;
+
+    for (int i = 0; i < jobs; i++)
+        close(result_fds[i]);
+    for (int i = 0; i < jobs; i++)
+        waitpid(pids[i], NULL, 0);
+    if (opt->freq)
+        pfreq_destroy(&exchange);
+
+    free(pids);
+    free(result_fds);
+    if (map)
+        munmap((void *)map, (size_t)size);
+    close(fd);
+
+    if (failed)
+    {
+        fprintf(stderr, "Error: did not receive wordcount result from every counting process.\n");
+        return EXIT_FAILURE;
+    }
+    if (freq_failed)
+    {
+        fprintf(stderr, "Error: did not receive the word frequency table from every counting process.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
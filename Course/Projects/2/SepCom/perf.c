@@ -0,0 +1,206 @@
+/*
+ * perf.c: hardware counters around the hot loops for --perf (see perf.h)
+ *
+ * All events form one group led by the cycles counter, so they are on the
+ * PMU together and IPC or misses per cycle compare like with like. An
+ * event the CPU does not have (LLC loads on some AMD parts, everything in
+ * a guest without a virtual PMU) is just left out of the group.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf.h"
+#include "ioutil.h"
+
+#define PERF_MAGIC 0x50435750u /* "PWCP" read as little-endian bytes */
+
+struct perf_counters *pwc_perf_active;
+
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+} events[PERF_NEVENTS] = {
+    [PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_BRANCHES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+    [PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [PERF_CACHE_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    [PERF_LLC_LOADS] = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                 (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16) },
+};
+
+static int open_event(int i, int user_only, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = group_fd < 0; /* members follow the leader */
+    attr.exclude_kernel = user_only;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    /* This thread, any CPU; no glibc wrapper exists */
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+void perf_begin(struct perf_counters *pc, int user_only)
+{
+    memset(pc, 0, sizeof(*pc));
+    for (int i = 0; i < PERF_NEVENTS; i++)
+        pc->fd[i] = -1;
+    pwc_perf_active = pc;
+
+    /* perf_event_paranoid >= 2 only allows user space: measure that rather than nothing */
+    int leader = open_event(PERF_CYCLES, user_only, -1);
+    if (leader < 0 && !user_only && (errno == EACCES || errno == EPERM))
+        leader = open_event(PERF_CYCLES, user_only = 1, -1);
+    if (leader < 0)
+    {
+        pc->sample.error = errno;
+        return;
+    }
+
+    pc->fd[PERF_CYCLES] = leader;
+    pc->sample.valid = 1u << PERF_CYCLES;
+    pc->sample.user_only = (uint32_t)user_only;
+    for (int i = PERF_CYCLES + 1; i < PERF_NEVENTS; i++)
+    {
+        pc->fd[i] = open_event(i, user_only, leader);
+        if (pc->fd[i] >= 0)
+            pc->sample.valid |= 1u << i;
+    }
+}
+
+void perf_start(struct perf_counters *pc)
+{
+    if (pc->fd[PERF_CYCLES] >= 0)
+        ioctl(pc->fd[PERF_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_stop(struct perf_counters *pc)
+{
+    int leader = pc->fd[PERF_CYCLES];
+    if (leader < 0)
+        return;
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    /* { nr, time_enabled, time_running, value[nr] }, values in the order the group was built */
+    uint64_t buf[3 + PERF_NEVENTS];
+    if (read(leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+    {
+        pc->sample.error = errno ? errno : EIO;
+        return;
+    }
+
+    uint64_t enabled = buf[1], running = buf[2];
+    if (running == 0)
+    {
+        /* The group never got the PMU (e.g. another perf user holds it) */
+        pc->sample.error = EBUSY;
+        return;
+    }
+
+    /* Totals are cumulative in the kernel, so later start/stop pairs just overwrite them */
+    pc->sample.scaled = running < enabled;
+    uint64_t n = 0;
+    for (int i = 0; i < PERF_NEVENTS && n < buf[0]; i++)
+    {
+        if (!(pc->sample.valid & (1u << i)))
+            continue;
+        uint64_t v = buf[3 + n++];
+        pc->sample.value[i] = running < enabled ? (uint64_t)((double)v * enabled / running) : v;
+    }
+}
+
+void perf_end(struct perf_counters *pc)
+{
+    for (int i = 0; i < PERF_NEVENTS; i++)
+    {
+        if (pc->fd[i] >= 0)
+            close(pc->fd[i]);
+        pc->fd[i] = -1;
+    }
+}
+
+void perf_send(int fd, const struct perf_sample *s)
+{
+    uint32_t magic = PERF_MAGIC;
+    write_all(fd, &magic, sizeof(magic));
+    write_all(fd, s, sizeof(*s));
+}
+
+int perf_recv(int fd, struct perf_sample *s)
+{
+    uint32_t magic;
+    if (read_all(fd, &magic, sizeof(magic)) != sizeof(magic) || magic != PERF_MAGIC)
+        return -1;
+    return read_all(fd, s, sizeof(*s)) == sizeof(*s) ? 0 : -1;
+}
+
+static int have(const struct perf_sample *s, int i)
+{
+    return (s->valid & (1u << i)) != 0;
+}
+
+void perf_print(const char *what, const struct perf_sample *s)
+{
+    if (s->error)
+    {
+        const char *why = strerror(s->error);
+        if (s->error == ENOENT || s->error == EOPNOTSUPP)
+            why = "no hardware PMU (container or VM?)";
+        else if (s->error == EACCES || s->error == EPERM)
+            why = "not permitted (see /proc/sys/kernel/perf_event_paranoid)";
+        else if (s->error == EBUSY)
+            why = "the counters were never scheduled";
+        printf("Process 1 (perf): %-20s unavailable: %s\n", what, why);
+        return;
+    }
+    if (s->value[PERF_CYCLES] == 0)
+    {
+        /* This process has no such loop (Process 1 with --transport=mmap) */
+        printf("Process 1 (perf): %-20s -\n", what);
+        return;
+    }
+
+    char line[256] = "";
+    int len = 0;
+    double cycles = (double)s->value[PERF_CYCLES];
+#define APPEND(...) len += snprintf(line + len, sizeof(line) - (size_t)len, __VA_ARGS__)
+
+    if (have(s, PERF_INSTRUCTIONS) && cycles > 0)
+        APPEND(" %.2f IPC,", (double)s->value[PERF_INSTRUCTIONS] / cycles);
+    if (s->bytes > 0)
+        APPEND(" %.3f cycles/byte,", cycles / (double)s->bytes);
+    if (have(s, PERF_BRANCH_MISSES) && have(s, PERF_BRANCHES) && s->value[PERF_BRANCHES] > 0)
+        APPEND(" %.2f%% branch misses,",
+               100.0 * (double)s->value[PERF_BRANCH_MISSES] / (double)s->value[PERF_BRANCHES]);
+    if (s->bytes > 0)
+    {
+        double kb = (double)s->bytes / 1024.0;
+        if (have(s, PERF_CACHE_MISSES))
+            APPEND(" %.2f cache misses/KiB,", (double)s->value[PERF_CACHE_MISSES] / kb);
+        if (have(s, PERF_LLC_LOADS))
+            APPEND(" %.2f LLC loads/KiB,", (double)s->value[PERF_LLC_LOADS] / kb);
+    }
+#undef APPEND
+    if (len > 0)
+        line[len - 1] = '\0'; /* the last comma */
+
+    printf("Process 1 (perf): %-20s%s (%s%s)\n", what, line, s->user_only ? "user space" : "user + kernel",
+           s->scaled ? ", multiplexed" : "");
+    printf("Process 1 (perf): %-20s %" PRIu64 " cycles, %" PRIu64 " instructions, %" PRIu64 " branch misses, %" PRIu64
+           " cache misses, %" PRIu64 " LLC loads\n",
+           "", s->value[PERF_CYCLES], s->value[PERF_INSTRUCTIONS], s->value[PERF_BRANCH_MISSES],
+           s->value[PERF_CACHE_MISSES], s->value[PERF_LLC_LOADS]);
+}
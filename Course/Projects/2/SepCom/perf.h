@@ -0,0 +1,69 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+/*
+ * Hardware performance counters for --perf (perf.c), via perf_event_open(2).
+ *
+ * Each process opens one counter group on itself and enables it only
+ * around its hot loop:
+ *   Process 1  the read loop (read/splice into pipe #1 or the shm ring),
+ *              kernel included when perf_event_paranoid allows it
+ *   Process 2  the counting loop, user space only: the pipe read()s are
+ *              kernel time and would hide what the kernels themselves do
+ * Process 2 sends its sample on pipe #2 and Process 1 prints IPC,
+ * cycles/byte, branch-miss rate and cache behaviour for both loops.
+ *
+ * No PMU (most containers and VMs), a strict perf_event_paranoid or a
+ * seccomp filter only turn the report into "unavailable: <reason>".
+ */
+enum perf_event_index
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCHES,
+    PERF_BRANCH_MISSES,
+    PERF_CACHE_MISSES,
+    PERF_LLC_LOADS,
+    PERF_NEVENTS
+};
+
+/* What one loop measured; fixed size so it can cross pipe #2 as is */
+struct perf_sample
+{
+    int32_t error;      /* errno of the failed cycles counter, 0 if counting worked */
+    uint32_t valid;     /* bit i set: value[i] was counted (a PMU may lack some events) */
+    uint32_t user_only; /* kernel time excluded */
+    uint32_t scaled;    /* the group shared the PMU (multiplexed); values are estimates */
+    uint64_t value[PERF_NEVENTS];
+    uint64_t bytes;     /* bytes the loop handled, for cycles/byte */
+};
+
+struct perf_counters
+{
+    int fd[PERF_NEVENTS]; /* -1 if not open; fd[PERF_CYCLES] is the group leader */
+    struct perf_sample sample;
+};
+
+/* This process's counters, or NULL when --perf is off */
+extern struct perf_counters *pwc_perf_active;
+
+/* Open the group, disabled (kernel + user, falling back to user only unless user_only is set) */
+void perf_begin(struct perf_counters *pc, int user_only);
+
+/* Count between start and stop; several start/stop pairs add up */
+void perf_start(struct perf_counters *pc);
+void perf_stop(struct perf_counters *pc);
+
+/* Close the descriptors (a forked child drops its parent's group with this) */
+void perf_end(struct perf_counters *pc);
+
+/* pipe #2 wire format: header { magic "PWCP" } then the sample; -1 on a short or bad message */
+void perf_send(int fd, const struct perf_sample *s);
+int perf_recv(int fd, struct perf_sample *s);
+
+/* One "Process 1 (perf): ..." line for the loop called `what` */
+void perf_print(const char *what, const struct perf_sample *s);
+
+#endif
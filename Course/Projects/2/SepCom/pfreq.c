@@ -0,0 +1,238 @@
+#define _GNU_SOURCE /* memfd_create() */
+
+#include "pfreq.h"
+#include "ioutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PFREQ_MAGIC 0x50435750u /* "PWCP": written LAST, so it marks a complete table */
+
+/*
+ * Layout of one worker's memfd:
+ *   struct pfreq_header, then partitions+1 uint64_t offsets,
+ *   then for each partition its records { hash, count, len, pad } + key bytes.
+ */
+struct pfreq_header
+{
+    uint32_t magic;
+    uint32_t partitions;
+};
+
+struct pfreq_record
+{
+    uint64_t hash;
+    uint64_t count;
+    uint32_t len;
+    uint32_t reserved;
+};
+
+/* Top bits of the hash pick the partition (multiply-shift, no modulo) */
+static uint32_t partition_of(uint64_t hash, uint32_t partitions)
+{
+    return (uint32_t)(((hash >> 32) * partitions) >> 32);
+}
+
+int pfreq_create(struct pfreq_exchange *x, int jobs)
+{
+    memset(x, 0, sizeof(*x));
+    x->jobs = jobs;
+    x->memfds = malloc((size_t)jobs * sizeof(int));
+    if (!x->memfds)
+        return -1;
+
+    for (int i = 0; i < jobs; i++)
+    {
+        x->memfds[i] = memfd_create("pwordcount-freq", MFD_CLOEXEC);
+        if (x->memfds[i] < 0)
+            return -1;
+    }
+
+    if (pipe(x->done_pipe) == -1 || pipe(x->go_pipe) == -1)
+        return -1;
+    return 0;
+}
+
+void pfreq_worker_setup(struct pfreq_exchange *x)
+{
+    /* A worker holding these ends would never see EOF on them */
+    close(x->done_pipe[READ_END]);
+    close(x->go_pipe[WRITE_END]);
+}
+
+/* Small write buffer so records are not one syscall each */
+struct out_buf
+{
+    int fd;
+    size_t len;
+    unsigned char data[64 * 1024];
+};
+
+static void out_put(struct out_buf *o, const void *p, size_t n)
+{
+    if (o->len + n > sizeof(o->data))
+    {
+        write_all(o->fd, o->data, o->len);
+        o->len = 0;
+    }
+    if (n > sizeof(o->data))
+    {
+        write_all(o->fd, p, n);
+        return;
+    }
+    memcpy(o->data + o->len, p, n);
+    o->len += n;
+}
+
+void pfreq_worker_publish(struct pfreq_exchange *x, int worker, const struct freq_table *t)
+{
+    uint32_t parts = (uint32_t)x->jobs;
+    int fd = x->memfds[worker];
+
+    /* Counting sort of the occupied slots by partition */
+    size_t *start = calloc(parts + 1, sizeof(*start));
+    size_t *order = malloc((t->used ? t->used : 1) * sizeof(*order));
+    uint64_t *offsets = calloc(parts + 1, sizeof(*offsets));
+    if (!start || !order || !offsets)
+        die_perror("malloc");
+
+    for (size_t i = 0; i < t->capacity; i++)
+        if (t->slots[i].key)
+            start[partition_of(t->slots[i].hash, parts) + 1]++;
+    for (uint32_t p = 0; p < parts; p++)
+        start[p + 1] += start[p];
+
+    size_t *fill = malloc((parts + 1) * sizeof(*fill));
+    if (!fill)
+        die_perror("malloc");
+    memcpy(fill, start, (parts + 1) * sizeof(*fill));
+    for (size_t i = 0; i < t->capacity; i++)
+        if (t->slots[i].key)
+            order[fill[partition_of(t->slots[i].hash, parts)]++] = i;
+
+    /* Records go after the header; the header (with the magic) goes last */
+    struct pfreq_header h = { 0, parts };
+    uint64_t pos = sizeof(h) + (parts + 1) * sizeof(uint64_t);
+    if (lseek(fd, (off_t)pos, SEEK_SET) < 0)
+        die_perror("lseek");
+
+    static struct out_buf o; /* 64 KiB: keep it off the stack */
+    o.fd = fd;
+    o.len = 0;
+
+    for (uint32_t p = 0; p < parts; p++)
+    {
+        offsets[p] = pos;
+        for (size_t k = start[p]; k < start[p + 1]; k++)
+        {
+            const struct freq_entry *e = &t->slots[order[k]];
+            struct pfreq_record r = { e->hash, e->count, e->len, 0 };
+            out_put(&o, &r, sizeof(r));
+            out_put(&o, e->key, e->len);
+            pos += sizeof(r) + e->len;
+        }
+    }
+    offsets[parts] = pos;
+    write_all(fd, o.data, o.len);
+
+    if (pwrite(fd, offsets, (parts + 1) * sizeof(uint64_t), sizeof(h)) < 0)
+        die_perror("pwrite");
+    h.magic = PFREQ_MAGIC;
+    if (pwrite(fd, &h, sizeof(h), 0) < 0)
+        die_perror("pwrite");
+
+    free(start);
+    free(fill);
+    free(order);
+    free(offsets);
+
+    /* Tell Process 1 we are done, then wait for everyone else */
+    close(x->done_pipe[WRITE_END]);
+
+    char c;
+    while (read(x->go_pipe[READ_END], &c, 1) < 0 && errno == EINTR)
+        ;
+    close(x->go_pipe[READ_END]);
+}
+
+void pfreq_worker_merge(struct pfreq_exchange *x, int worker, struct freq_table *out)
+{
+    for (int w = 0; w < x->jobs; w++)
+    {
+        struct stat st;
+        if (fstat(x->memfds[w], &st) < 0)
+            die_perror("fstat");
+
+        const unsigned char *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, x->memfds[w], 0);
+        if (base == MAP_FAILED)
+            die_perror("mmap");
+
+        uint64_t from, to;
+        memcpy(&from, base + sizeof(struct pfreq_header) + (size_t)worker * sizeof(uint64_t), sizeof(from));
+        memcpy(&to, base + sizeof(struct pfreq_header) + (size_t)(worker + 1) * sizeof(uint64_t), sizeof(to));
+
+        /* Our partition of worker w's table: insert with the stored hash */
+        while (from < to)
+        {
+            struct pfreq_record r;
+            memcpy(&r, base + from, sizeof(r));
+            from += sizeof(r);
+            freq_add_count(out, base + from, r.len, r.hash, r.count);
+            from += r.len;
+        }
+
+        munmap((void *)base, (size_t)st.st_size);
+    }
+}
+
+int pfreq_parent_sync(struct pfreq_exchange *x)
+{
+    /* Only workers hold write ends now: EOF = every worker published or died */
+    close(x->done_pipe[WRITE_END]);
+    x->done_pipe[WRITE_END] = -1;
+    close(x->go_pipe[READ_END]);
+    x->go_pipe[READ_END] = -1;
+
+    char c;
+    ssize_t r;
+    while ((r = read(x->done_pipe[READ_END], &c, 1)) != 0)
+    {
+        if (r < 0 && errno != EINTR)
+            return -1;
+    }
+
+    int ok = 1;
+    for (int w = 0; w < x->jobs; w++)
+    {
+        struct pfreq_header h;
+        if (pread(x->memfds[w], &h, sizeof(h), 0) != (ssize_t)sizeof(h) || h.magic != PFREQ_MAGIC)
+            ok = 0;
+    }
+    if (!ok)
+        return -1;
+
+    /* Release the barrier: workers see EOF on the go pipe */
+    close(x->go_pipe[WRITE_END]);
+    x->go_pipe[WRITE_END] = -1;
+    return 0;
+}
+
+void pfreq_destroy(struct pfreq_exchange *x)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (x->done_pipe[i] >= 0)
+            close(x->done_pipe[i]);
+        if (x->go_pipe[i] >= 0)
+            close(x->go_pipe[i]);
+    }
+    for (int i = 0; x->memfds && i < x->jobs; i++)
+        close(x->memfds[i]);
+    free(x->memfds);
+    x->memfds = NULL;
+}
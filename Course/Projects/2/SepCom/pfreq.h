@@ -0,0 +1,51 @@
+#ifndef PFREQ_H
+#define PFREQ_H
+
+#include "freq.h"
+
+/*
+ * Parallel --freq for -j N (pfreq.c).
+ *
+ * Every counting process builds its own table for its byte range. The
+ * tables are then merged WITHOUT locks by radix-partitioning on the hash:
+ *
+ *   phase 1  worker w writes its table to its own memfd, grouped into N
+ *            partitions by the top bits of each word's hash
+ *   barrier  Process 1 waits until every worker has published
+ *   phase 2  worker p maps all N memfds and merges partition p only
+ *
+ * A word always hashes to the same partition, so the merged partitions
+ * are disjoint: no two workers ever touch the same key, and each one ends
+ * up with the exact counts for its share of the vocabulary.
+ */
+struct pfreq_exchange
+{
+    int jobs;
+    int *memfds;     /* one per worker, created before fork() */
+    int done_pipe[2]; /* workers close their write end when published */
+    int go_pipe[2];   /* Process 1 closes the write end to start phase 2 */
+};
+
+/* Process 1, before forking the workers. Returns 0 or -1 (errno set). */
+int pfreq_create(struct pfreq_exchange *x, int jobs);
+
+/* Worker, right after fork(): drop the pipe ends it must not hold */
+void pfreq_worker_setup(struct pfreq_exchange *x);
+
+/* Worker, phase 1: publish the table and wait for the barrier */
+void pfreq_worker_publish(struct pfreq_exchange *x, int worker, const struct freq_table *t);
+
+/* Worker, phase 2: merge partition `worker` of every published table into out */
+void pfreq_worker_merge(struct pfreq_exchange *x, int worker, struct freq_table *out);
+
+/*
+ * Process 1, after forking all workers: wait until every worker published
+ * (or died), then release them into phase 2. Returns 0 if all tables are
+ * complete, -1 if a worker failed (the caller should kill the others).
+ */
+int pfreq_parent_sync(struct pfreq_exchange *x);
+
+/* Close whatever this process still holds */
+void pfreq_destroy(struct pfreq_exchange *x);
+
+#endif
@@ -0,0 +1,146 @@
+#define _GNU_SOURCE /* F_SETPIPE_SZ */
+
+#include "pipetune.h"
+#include "ioutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+
+/* Each probe moves this many bytes; enough to amortise fork() noise */
+#define PROBE_BYTES (32u * 1024 * 1024)
+
+#define DEFAULT_PIPE_MAX (1024 * 1024)
+
+static const size_t candidate_chunks[] = {
+    4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024,
+};
+
+size_t pipetune_max_size(void)
+{
+    FILE *fp = fopen("/proc/sys/fs/pipe-max-size", "r");
+    if (!fp)
+        return DEFAULT_PIPE_MAX;
+
+    unsigned long v = 0;
+    if (fscanf(fp, "%lu", &v) != 1 || v == 0)
+        v = DEFAULT_PIPE_MAX;
+    fclose(fp);
+    return (size_t)v;
+}
+
+long pipetune_set_capacity(int fd, size_t bytes)
+{
+    if (fcntl(fd, F_SETPIPE_SZ, (int)bytes) < 0)
+        return -1;
+    return fcntl(fd, F_GETPIPE_SZ);
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * probe:
+ * A writer child pushes PROBE_BYTES through a fresh pipe while we drain it,
+ * both sides using the same chunk size - exactly what pipe1 will see.
+ * Returns MB/s, or a negative value if the probe could not run.
+ */
+static double probe(size_t chunk, size_t pipe_size, unsigned char *buf)
+{
+    int fds[2];
+    if (pipe(fds) == -1)
+        return -1.0;
+
+    if (pipetune_set_capacity(fds[WRITE_END], pipe_size) < 0)
+    {
+        close(fds[READ_END]);
+        close(fds[WRITE_END]);
+        return -1.0;
+    }
+
+    double start = now_sec();
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[READ_END]);
+        close(fds[WRITE_END]);
+        return -1.0;
+    }
+
+    if (pid == 0)
+    {
+        /* Writer: same buffer contents as the parent, no extra allocation */
+        close(fds[READ_END]);
+        for (size_t sent = 0; sent < PROBE_BYTES; sent += chunk)
+            write_all(fds[WRITE_END], buf, chunk);
+        close(fds[WRITE_END]);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[WRITE_END]);
+
+    size_t total = 0;
+    while (1)
+    {
+        size_t got = read_all(fds[READ_END], buf, chunk);
+        if (got == 0)
+            break;
+        total += got;
+    }
+
+    close(fds[READ_END]);
+    waitpid(pid, NULL, 0);
+
+    double elapsed = now_sec() - start;
+    if (total == 0 || elapsed <= 0.0)
+        return -1.0;
+    return (double)total / (1024.0 * 1024.0) / elapsed;
+}
+
+int pipetune_auto(struct pipe_tuning *best)
+{
+    size_t max_pipe = pipetune_max_size();
+    size_t max_chunk = candidate_chunks[sizeof(candidate_chunks) / sizeof(candidate_chunks[0]) - 1];
+
+    unsigned char *buf = malloc(max_chunk);
+    if (!buf)
+        return -1;
+    memset(buf, 'x', max_chunk);
+
+    memset(best, 0, sizeof(*best));
+
+    /* Pipe capacities: 64 KiB (the default) and every 4x step up to the limit */
+    for (size_t pipe_size = 64 * 1024; pipe_size <= max_pipe; pipe_size *= 4)
+    {
+        for (size_t i = 0; i < sizeof(candidate_chunks) / sizeof(candidate_chunks[0]); i++)
+        {
+            size_t chunk = candidate_chunks[i];
+            if (chunk > pipe_size)
+                break; /* a chunk larger than the pipe only adds partial writes */
+
+            double rate = probe(chunk, pipe_size, buf);
+            if (rate > best->mb_per_sec)
+            {
+                best->chunk = chunk;
+                best->pipe_size = pipe_size;
+                best->mb_per_sec = rate;
+            }
+        }
+
+        /* Make sure the exact limit gets tried when it is not a 4x step */
+        if (pipe_size < max_pipe && pipe_size * 4 > max_pipe)
+            pipe_size = max_pipe / 4;
+    }
+
+    free(buf);
+    return best->chunk ? 0 : -1;
+}
@@ -0,0 +1,35 @@
+#ifndef PIPETUNE_H
+#define PIPETUNE_H
+
+#include <stddef.h>
+
+/* One (chunk size, pipe capacity) combination and how fast it moved data */
+struct pipe_tuning
+{
+    size_t chunk;      /* bytes per read()/write() call */
+    size_t pipe_size;  /* kernel pipe capacity (F_SETPIPE_SZ) */
+    double mb_per_sec; /* measured by pipetune_auto(), 0 if not measured */
+};
+
+/*
+ * Largest pipe capacity an unprivileged process may ask for,
+ * read from /proc/sys/fs/pipe-max-size (1 MiB if it cannot be read).
+ */
+size_t pipetune_max_size(void);
+
+/*
+ * Resize a pipe with F_SETPIPE_SZ.
+ * The kernel rounds the size up to a power-of-two number of pages, so the
+ * capacity it actually granted is returned (or -1 with errno set).
+ */
+long pipetune_set_capacity(int fd, size_t bytes);
+
+/*
+ * Auto-tune: push a fixed amount of data through a scratch pipe for every
+ * candidate chunk size and pipe capacity (up to pipetune_max_size()) and
+ * keep the fastest combination. Takes a fraction of a second.
+ * Returns 0 on success, -1 if no probe could be run.
+ */
+int pipetune_auto(struct pipe_tuning *best);
+
+#endif
@@ -4,7 +4,7 @@
  * What this program does:
  *   - Process 1 (parent) reads a text file and sends its bytes to Process 2 using Pipe #1.
  *   - Process 2 (child) reads those bytes, counts how many words are in the file,
- *     then sends the integer result back to Process 1 using Pipe #2.
+ *     then sends the result (a 64-bit count, see result.h) back to Process 1 using Pipe #2.
  *   - Process 1 prints the final word count.
  *
  * Key requirements covered:
@@ -13,101 +13,759 @@
  *   - file is read in a loop (supports large files)
  *   - word counting works even when words are split across chunks (handled in wordcount.c)
  *   - error checking + clean termination (no weird extra prints on error)
+ *
+ * Transports (--transport=NAME):
+ *   copy     (default) Process 1 fread()s chunks and writes them into pipe #1.
+ *   splice   Process 1 splice()s the file straight into pipe #1, so the bytes
+ *            never pass through a user-space buffer in Process 1.
+ *   mmap     Process 1 maps the file into memory BEFORE fork(), so Process 2
+ *            inherits the same mapping and counts the page cache directly.
+ *            Only the result crosses pipe #2; no file bytes are copied through pipe #1.
+ *            "--mmap" is accepted as a shorthand.
+ *   shm      Process 1 read()s the file straight into the slots of a shared-memory
+ *            ring (shmring.c) and Process 2 counts them in place; handing a chunk
+ *            over is an atomic index bump, with a futex sleep only when the ring
+ *            is full or empty. --chunk sets the slot size, --pipe-size the ring size.
+ *
+ * Tuning (pipe transports):
+ *   --chunk=SIZE       bytes per fread()/read()/splice() call (default 4096, splice 64K)
+ *   --pipe-size=SIZE   pipe #1 capacity via F_SETPIPE_SZ (default: kernel's 64K)
+ *   --autotune         probe chunk/capacity pairs up to /proc/sys/fs/pipe-max-size
+ *                      and use (and print) the fastest one
+ *
+ * Threads instead of processes:
+ *   --threads          no fork() and no pipes: a reader thread fills the slots of
+ *                      the same ring as --transport=shm and a counter thread counts
+ *                      them (threads.c), to compare both designs on one binary
+ *
+ * Daemon (daemon.c):
+ *   --daemon=SOCKET    keep a pool of counting processes (-j N, default 4) warm
+ *                      behind a Unix socket; runs until SIGTERM/SIGINT
+ *   --connect=SOCKET   count <file_name> through that daemon (the file descriptor
+ *                      is passed over the socket); PWORDCOUNT_SOCKET=SOCKET in the
+ *                      environment does the same, falling back to local counting
+ *                      if no daemon answers
+ *
+ * Result cache (cache.c):
+ *   --cache=FILE       remember the counts of each file keyed by (device, inode,
+ *                      size, mtime) in a fixed-size table mapped from FILE, and
+ *                      answer an unchanged file from it after one stat();
+ *                      PWORDCOUNT_CACHE=FILE in the environment does the same
+ *
+ * Append-only files (checkpoint.c):
+ *   --checkpoint=FILE  save where counting stopped (offset, streaming state, a hash
+ *                      of the last 4 KiB); the next run of the same file resumes
+ *                      there and only reads the appended bytes. A truncated or
+ *                      replaced file is counted from the start. Pipe transports only.
+ *
+ * Growing files (follow.c):
+ *   --follow           after EOF keep waiting (inotify) for appended bytes and
+ *                      send only those; Process 2 reports updated totals every
+ *                      interval. Survives truncation and rotation; stop with Ctrl-C.
+ *   --interval=SECONDS how often --follow totals are reported (default 1)
+ *
+ * Instrumentation (stats.c, perf.c):
+ *   --stats            time, bytes and calls per stage in both processes (file
+ *                      read, pipe #1 write, pipe #1 read, counting), short
+ *                      reads/writes and EINTR retries, printed after the result
+ *   --perf             hardware counters (perf.c) around Process 1's read loop and
+ *                      Process 2's counting loop: IPC, cycles/byte, branch-miss
+ *                      rate, cache misses; only reported as unavailable where
+ *                      perf events are not (containers, perf_event_paranoid)
+ *
+ * Compressed input (decompress.c):
+ *   a file starting with the gzip or zstd magic number is decompressed by a
+ *   third process between the reader and the counter (copy/splice transports);
+ *   zstd files with several frames are decompressed by a pool of threads
+ *
+ * Many files:
+ *   ./pwordcount [options] PATH...   with several paths or a directory, every
+ *                      regular file found is counted by a thread pool (-j N
+ *                      threads, default one per CPU) and a wc-style table with
+ *                      one row per file plus a total is printed (multi.c)
+ *
+ * Reading (copy transport):
+ *   --uring[=DEPTH]    Process 1 reads with io_uring, keeping DEPTH chunk reads in
+ *                      flight (default 8) instead of one read() at a time (uring.c);
+ *                      falls back to read() if io_uring is unavailable
+ *
+ * Counting kernel:
+ *   --kernel=NAME      force scalar/sse2/avx2/avx512bw instead of the CPU's best
+ *                      (see wordcount.h), mainly for benchmarking
+ *
+ * Parallel counting:
+ *   -j N, --jobs=N     split the file into N byte ranges counted by N processes
+ *                      (parallel.c); with --mmap they share one mapping
+ *
+ * Metrics (like wc, all counted in the same single pass; default -w):
+ *   -l lines   -w words   -c bytes   -m UTF-8 characters   -L longest line
+ *   --utf8             words are separated by Unicode whitespace (U+00A0,
+ *                      U+3000, ...) instead of ASCII whitespace only
+ *
+ * Word frequencies (freq.c):
+ *   --freq             Process 2 also builds a word -> count table and streams it
+ *                      back over pipe #2, most frequent first
+ *   --top=K            only the K most frequent words cross the pipe (implies --freq)
+ *
+ * Distinct words (hll.c):
+ *   --distinct[=P]     estimate the number of distinct words with a HyperLogLog
+ *                      sketch of 2^P registers (P = 4..16, default 12: 4 KiB, ~1.6%)
  */
 
+#define _GNU_SOURCE /* splice() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include "wordcount.h"
+#include "ioutil.h"
+#include "pipetune.h"
+#include "pwordcount.h"
+#include "result.h"
+#include "tokens.h"
+#include "shmring.h"
+#include "uring.h"
+#include "cache.h"
+#include "checkpoint.h"
+#include "stats.h"
+#include "perf.h"
+
+/* --mmap: bytes summarized at a time, sized to stay in L2 cache */
+#define MMAP_SLICE (256 * 1024)
 
-#define READ_END 0
-#define WRITE_END 1
-#define BUF_SIZE 4096
+/* Bytes requested per splice() call when no chunk size is given: the default pipe capacity */
+#define SPLICE_CHUNK (64 * 1024)
 
-/* Print system error message and exit */
-static void die_perror(const char *msg)
+static void print_usage(void)
 {
-    perror(msg);
-    exit(EXIT_FAILURE);
+    printf("Usage: ./pwordcount [--transport=copy|splice|mmap|shm] [--mmap]\n"
+           "                    [--chunk=SIZE] [--pipe-size=SIZE] [--autotune] [--uring[=DEPTH]]\n"
+           "                    [--kernel=auto|scalar|sse2|avx2|avx512bw] [-j N]\n"
+           "                    [-l] [-w] [-c] [-m] [-L] [--utf8] [--freq] [--top=K]\n"
+           "                    [--distinct[=P]] [--threads] [--cache=FILE] [--checkpoint=FILE]\n"
+           "                    [--follow [--interval=SECONDS]] [--stats] [--perf]\n"
+           "                    <file_name> [more files or directories]\n"
+           "       ./pwordcount --daemon=SOCKET [-j N]\n"
+           "       ./pwordcount --connect=SOCKET [-l] [-w] [-c] [-m] [-L] [--utf8] <file_name>\n");
 }
 
 /*
- * write_all:
- * Pipes do NOT guarantee that write(fd, buf, n) writes all n bytes in one call.
- * This function keeps writing until every byte is sent (or a real error happens).
+ * parse_args:
+ * Options start with "--"; the first other argument is the file name.
+ * Returns 0 on success, -1 if the command line is not usable.
  */
-static void write_all(int fd, const void *buf, size_t n)
+static int parse_args(int argc, char *argv[], struct options *opt)
 {
-    const unsigned char *p = (const unsigned char *)buf;
-    size_t sent = 0;
+    memset(opt, 0, sizeof(*opt));
 
-    while (sent < n)
+    for (int i = 1; i < argc; i++)
     {
-        ssize_t w = write(fd, p + sent, n - sent);
-        if (w < 0)
+        const char *arg = argv[i];
+
+        if (strcmp(arg, "--mmap") == 0)
         {
-            if (errno == EINTR)
-                continue; /* interrupted: try again */
-            die_perror("write");
+            opt->transport = TRANSPORT_MMAP;
+        }
+        else if (strncmp(arg, "--transport=", 12) == 0)
+        {
+            const char *name = arg + 12;
+            if (strcmp(name, "copy") == 0)
+                opt->transport = TRANSPORT_COPY;
+            else if (strcmp(name, "splice") == 0)
+                opt->transport = TRANSPORT_SPLICE;
+            else if (strcmp(name, "mmap") == 0)
+                opt->transport = TRANSPORT_MMAP;
+            else if (strcmp(name, "shm") == 0)
+                opt->transport = TRANSPORT_SHM;
+            else
+            {
+                fprintf(stderr, "Error: unknown transport \"%s\" (use copy, splice, mmap or shm).\n", name);
+                return -1;
+            }
+        }
+        else if (strncmp(arg, "--chunk=", 8) == 0)
+        {
+            if (parse_size(arg + 8, &opt->chunk) < 0 || opt->chunk == 0 || opt->chunk > MAX_CHUNK)
+            {
+                fprintf(stderr, "Error: invalid chunk size \"%s\".\n", arg + 8);
+                return -1;
+            }
+        }
+        else if (strncmp(arg, "--pipe-size=", 12) == 0)
+        {
+            if (parse_size(arg + 12, &opt->pipe_size) < 0 || opt->pipe_size == 0)
+            {
+                fprintf(stderr, "Error: invalid pipe size \"%s\".\n", arg + 12);
+                return -1;
+            }
+        }
+        else if (strcmp(arg, "--autotune") == 0)
+        {
+            opt->autotune = 1;
+        }
+        else if (strncmp(arg, "--daemon=", 9) == 0 && arg[9] != '\0')
+        {
+            opt->daemon_socket = arg + 9;
+        }
+        else if (strncmp(arg, "--connect=", 10) == 0 && arg[10] != '\0')
+        {
+            opt->connect_socket = arg + 10;
+        }
+        else if (strncmp(arg, "--cache=", 8) == 0 && arg[8] != '\0')
+        {
+            opt->cache_path = arg + 8;
+        }
+        else if (strncmp(arg, "--checkpoint=", 13) == 0 && arg[13] != '\0')
+        {
+            opt->checkpoint_path = arg + 13;
+        }
+        else if (strcmp(arg, "--stats") == 0)
+        {
+            opt->stats = 1;
+        }
+        else if (strcmp(arg, "--perf") == 0)
+        {
+            opt->perf = 1;
+        }
+        else if (strcmp(arg, "--follow") == 0)
+        {
+            opt->follow = 1;
+        }
+        else if (strncmp(arg, "--interval=", 11) == 0)
+        {
+            char *end;
+            double seconds = strtod(arg + 11, &end);
+            if (arg[11] == '\0' || *end != '\0' || !(seconds >= 0.001 && seconds <= 86400))
+            {
+                fprintf(stderr, "Error: invalid --interval \"%s\" (0.001..86400 seconds).\n", arg + 11);
+                return -1;
+            }
+            opt->interval_ms = (unsigned)(seconds * 1000);
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            opt->threads = 1;
+        }
+        else if (strcmp(arg, "--uring") == 0)
+        {
+            opt->uring_depth = URING_DEFAULT_DEPTH;
+        }
+        else if (strncmp(arg, "--uring=", 8) == 0)
+        {
+            char *end;
+            long depth = strtol(arg + 8, &end, 10);
+            if (arg[8] == '\0' || *end != '\0' || depth < 1 || depth > URING_MAX_DEPTH)
+            {
+                fprintf(stderr, "Error: invalid io_uring queue depth \"%s\" (1..%d).\n", arg + 8, URING_MAX_DEPTH);
+                return -1;
+            }
+            opt->uring_depth = (unsigned)depth;
+        }
+        else if (strncmp(arg, "--kernel=", 9) == 0)
+        {
+            /* Set before fork(), so Process 2 inherits the choice */
+            if (wordcount_set_kernel(arg + 9) < 0)
+            {
+                fprintf(stderr, "Error: counting kernel \"%s\" is unknown or not supported by this CPU.\n", arg + 9);
+                return -1;
+            }
+        }
+        else if (strcmp(arg, "-j") == 0 || strncmp(arg, "--jobs=", 7) == 0)
+        {
+            const char *val = (arg[1] == 'j') ? (i + 1 < argc ? argv[++i] : "") : arg + 7;
+            char *end;
+            long n = strtol(val, &end, 10);
+            if (*val == '\0' || *end != '\0' || n < 1 || n > MAX_JOBS)
+            {
+                fprintf(stderr, "Error: invalid number of jobs \"%s\" (1..%d).\n", val, MAX_JOBS);
+                return -1;
+            }
+            opt->jobs = (int)n;
+        }
+        else if (strcmp(arg, "-l") == 0 || strcmp(arg, "--lines") == 0)
+            opt->metrics |= WC_LINES;
+        else if (strcmp(arg, "-w") == 0 || strcmp(arg, "--words") == 0)
+            opt->metrics |= WC_WORDS;
+        else if (strcmp(arg, "-c") == 0 || strcmp(arg, "--bytes") == 0)
+            opt->metrics |= WC_BYTES;
+        else if (strcmp(arg, "-m") == 0 || strcmp(arg, "--chars") == 0)
+            opt->metrics |= WC_CHARS;
+        else if (strcmp(arg, "-L") == 0 || strcmp(arg, "--max-line-length") == 0)
+            opt->metrics |= WC_MAX_LINE;
+        else if (strcmp(arg, "--utf8") == 0)
+            opt->utf8 = 1;
+        else if (strcmp(arg, "--freq") == 0)
+            opt->freq = 1;
+        else if (strcmp(arg, "--distinct") == 0)
+            opt->distinct = HLL_DEFAULT_PRECISION;
+        else if (strncmp(arg, "--distinct=", 11) == 0)
+        {
+            char *end;
+            long p = strtol(arg + 11, &end, 10);
+            if (arg[11] == '\0' || *end != '\0' || p < HLL_MIN_PRECISION || p > HLL_MAX_PRECISION)
+            {
+                fprintf(stderr, "Error: invalid --distinct precision \"%s\" (%d..%d).\n",
+                        arg + 11, HLL_MIN_PRECISION, HLL_MAX_PRECISION);
+                return -1;
+            }
+            opt->distinct = (unsigned)p;
+        }
+        else if (strncmp(arg, "--top=", 6) == 0)
+        {
+            char *end;
+            unsigned long long k = strtoull(arg + 6, &end, 10);
+            if (arg[6] == '\0' || *end != '\0' || arg[6] == '-')
+            {
+                fprintf(stderr, "Error: invalid --top value \"%s\".\n", arg + 6);
+                return -1;
+            }
+            opt->top = (size_t)k;
+            opt->freq = 1;
         }
-        sent += (size_t)w;
+        else if (strncmp(arg, "--", 2) == 0)
+        {
+            fprintf(stderr, "Error: unknown option \"%s\".\n", arg);
+            return -1;
+        }
+        else
+        {
+            /* Every other argument is a file or directory (multi.c for more than one file) */
+            if (!opt->paths)
+            {
+                opt->paths = malloc((size_t)argc * sizeof(*opt->paths));
+                if (!opt->paths)
+                    die_perror("malloc");
+            }
+            opt->paths[opt->npaths++] = arg;
+            if (!opt->filename)
+                opt->filename = arg;
+        }
+    }
+
+    /* Like the original tool: words only unless something else was asked for */
+    if (opt->metrics == 0)
+        opt->metrics = WC_WORDS;
+    if (opt->interval_ms == 0)
+        opt->interval_ms = FOLLOW_INTERVAL_MS;
+    if (opt->utf8)
+        opt->metrics |= WC_UTF8;
+
+    if (opt->freq && opt->utf8)
+    {
+        fprintf(stderr, "Error: --freq uses byte-mode word boundaries and cannot be combined with --utf8.\n");
+        return -1;
+    }
+    if (opt->threads && (opt->transport != TRANSPORT_COPY || opt->jobs > 1))
+    {
+        fprintf(stderr, "Error: --threads replaces the transports and -j; it cannot be combined with them.\n");
+        return -1;
+    }
+    if (opt->uring_depth && (opt->transport != TRANSPORT_COPY || opt->jobs > 1 || opt->threads))
+    {
+        fprintf(stderr, "Error: --uring only applies to the copy transport without -j or --threads.\n");
+        return -1;
+    }
+    if (opt->distinct && opt->utf8)
+    {
+        fprintf(stderr, "Error: --distinct uses byte-mode word boundaries and cannot be combined with --utf8.\n");
+        return -1;
     }
+    if ((opt->stats || opt->perf) && (opt->jobs > 1 || opt->threads || opt->follow))
+    {
+        fprintf(stderr, "Error: --stats and --perf measure the two-process pipeline; they cannot be combined "
+                        "with -j, --threads or --follow.\n");
+        return -1;
+    }
+    if (opt->follow && (opt->transport != TRANSPORT_COPY || opt->jobs > 1 || opt->threads || opt->uring_depth ||
+                        opt->freq || opt->distinct || opt->checkpoint_path || opt->cache_path))
+    {
+        fprintf(stderr, "Error: --follow uses its own pipe loop; it cannot be combined with --transport, -j, "
+                        "--threads, --uring, --freq, --distinct, --checkpoint or --cache.\n");
+        return -1;
+    }
+    if (opt->checkpoint_path && ((opt->transport != TRANSPORT_COPY && opt->transport != TRANSPORT_SPLICE) ||
+                                 opt->jobs > 1 || opt->threads || opt->uring_depth || opt->freq || opt->distinct))
+    {
+        fprintf(stderr, "Error: --checkpoint only applies to the copy and splice transports, "
+                        "without -j, --threads, --uring, --freq or --distinct.\n");
+        return -1;
+    }
+
+    return 0;
 }
 
 /*
- * read_all:
- * Reads up to n bytes unless EOF occurs first.
- * We mainly use it to safely read the final integer result from pipe2.
+ * Receive the result message from pipe2, reap the child and print the answer.
+ * Shared by every mode, because pipe2 always carries the same message (result.h).
  */
-static size_t read_all(int fd, void *buf, size_t n)
+static int finish_parent(const struct options *opt, pid_t pid, int result_fd)
 {
-    unsigned char *p = (unsigned char *)buf;
-    size_t total = 0;
+    struct wc_result result;
+    int rc = recv_result(result_fd, &result);
 
-    while (total < n)
+    if (rc < 0)
     {
-        ssize_t r = read(fd, p + total, n - total);
-        if (r < 0)
+        close(result_fd);
+        fprintf(stderr, "Error: did not receive wordcount result from Process 2.\n");
+        waitpid(pid, NULL, 0);
+        return EXIT_FAILURE;
+    }
+
+    print_counts(result.metrics, &result.counts);
+    result_cache_store(opt->cache, &result.counts);
+
+    /* With --checkpoint Process 2's unfinished stream follows, to resume from next time */
+    if (opt->checkpoint)
+    {
+        struct wc_stream state;
+        if (checkpoint_recv_state(result_fd, &state) < 0)
         {
-            if (errno == EINTR)
-                continue; /* interrupted: try again */
-            die_perror("read");
+            fprintf(stderr, "Error: did not receive the counting state from Process 2.\n");
+            rc = -1;
         }
-        if (r == 0)
-            break; /* EOF */
-        total += (size_t)r;
+        else if (checkpoint_save(opt->checkpoint, opt->filename, &state) < 0)
+        {
+            fprintf(stderr, "Warning: cannot save checkpoint \"%s\": %s\n", opt->checkpoint->path, strerror(errno));
+        }
+    }
+
+    /* With --stats Process 2's measurements come next; printed last, after everything else */
+    struct pwc_stats child_stats;
+    int have_stats = 0;
+    if (rc == 0 && pwc_stats_active)
+    {
+        have_stats = stats_recv(result_fd, &child_stats) == 0;
+        if (!have_stats)
+            fprintf(stderr, "Warning: did not receive the statistics from Process 2.\n");
     }
 
-    return total;
+    /* Then, with --perf, the counters of its counting loop */
+    struct perf_sample child_perf;
+    int have_perf = 0;
+    if (rc == 0 && pwc_perf_active)
+    {
+        have_perf = perf_recv(result_fd, &child_perf) == 0;
+        if (!have_perf)
+            fprintf(stderr, "Warning: did not receive the hardware counters from Process 2.\n");
+    }
+
+    /* With --distinct the sketch follows the result on the same pipe */
+    if (opt->distinct)
+    {
+        struct hll sketch;
+        if (hll_recv(result_fd, &sketch) < 0)
+        {
+            fprintf(stderr, "Error: did not receive the distinct-word sketch from Process 2.\n");
+            rc = -1;
+        }
+        else
+        {
+            hll_print(&sketch);
+            hll_free(&sketch);
+        }
+    }
+
+    /* With --freq the frequency table comes last */
+    if (rc == 0 && opt->freq && freq_recv_print(result_fd) < 0)
+    {
+        fprintf(stderr, "Error: did not receive the word frequency table from Process 2.\n");
+        rc = -1;
+    }
+
+    close(result_fd);
+    waitpid(pid, NULL, 0);
+
+    if (have_stats)
+    {
+        pwc_stats_active->wall_ns = stats_clock() - pwc_stats_active->start_ns;
+        stats_print(pwc_stats_active, &child_stats);
+    }
+    if (have_perf)
+    {
+        /* Both loops moved the same bytes; only Process 2 knows how many */
+        struct perf_sample *reader = &pwc_perf_active->sample;
+        reader->bytes = child_perf.bytes;
+        perf_print("Process 1 read loop", reader);
+        perf_print("Process 2 count loop", &child_perf);
+        perf_end(pwc_perf_active);
+    }
+    return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-int main(int argc, char *argv[])
+/*
+ * --perf in Process 2: the inherited group counts Process 1, so close it
+ * and open our own, user space only (see perf.h), enabled from here on.
+ */
+static struct perf_counters *counter_perf_start(void)
 {
-    /* Make stdout unbuffered so prints from parent/child show up immediately */
-    setvbuf(stdout, NULL, _IONBF, 0);
+    struct perf_counters *pc = pwc_perf_active;
+    if (pc)
+    {
+        perf_end(pc);
+        perf_begin(pc, 1);
+        perf_start(pc);
+    }
+    return pc;
+}
 
-    /* If user didn't give a file name, print the required usage message */
-    if (argc < 2)
+static void counter_perf_stop(struct perf_counters *pc, uint64_t bytes)
+{
+    if (pc)
     {
-        printf("Please enter a file name.\n");
-        printf("Usage: ./pwordcount <file_name>\n");
-        return EXIT_FAILURE;
+        perf_stop(pc);
+        pc->sample.bytes = bytes;
+    }
+}
+
+/* write_all() into pipe1, timed as the "write" stage with --stats */
+static void send_chunk(int out_fd, const void *buf, size_t n)
+{
+    struct pwc_stats *st = pwc_stats_active;
+    uint64_t t0 = st ? stats_clock() : 0;
+    write_all(out_fd, buf, n);
+    if (st)
+        stats_stage_add(&st->write, t0, n);
+}
+
+/*
+ * send_by_uring:
+ * Same bytes as send_by_copy(), but the file is read through io_uring with
+ * `depth` reads in flight (uring.h), so the next chunks are already loading
+ * while this one is written into pipe1.
+ * Returns 0 on success, -1 on error, 1 if io_uring cannot be used (nothing sent).
+ */
+static int send_by_uring(int fd, const char *filename, int out_fd, size_t chunk, unsigned depth)
+{
+    struct uring_reader reader;
+    if (uring_reader_open(&reader, fd, chunk, depth) < 0)
+    {
+        fprintf(stderr, "Warning: io_uring is not available (%s), using read().\n", strerror(errno));
+        return 1;
     }
 
-    const char *filename = argv[1];
+    printf("Process 1 starts sending data to Process 2 (io_uring, %u reads in flight) ...\n", depth);
+
+    struct pwc_stats *st = pwc_stats_active;
+    int rc = 0;
+    while (1)
+    {
+        const unsigned char *data;
+        uint64_t t0 = st ? stats_clock() : 0;
+        ssize_t n = uring_reader_next(&reader, &data);
+        if (st && n >= 0)
+            stats_stage_add(&st->read, t0, (uint64_t)n);
+        if (n < 0)
+        {
+            fprintf(stderr, "Error: failed while reading \"%s\": %s\n", filename, strerror(errno));
+            rc = -1;
+            break;
+        }
+        if (n == 0)
+            break;
+        send_chunk(out_fd, data, (size_t)n);
+    }
+
+    uring_reader_close(&reader);
+    return rc;
+}
+
+/*
+ * send_by_copy:
+ * Classic transport: fread() a chunk into our own buffer, then write_all() it
+ * into pipe1. Every byte is copied kernel->user here and user->kernel again.
+ * With --uring the reads go through send_by_uring() instead.
+ * Sending starts at byte `start` (a --checkpoint offset, 0 otherwise).
+ * Returns 0 on success, -1 on error (after printing a message).
+ */
+static int send_by_copy(const char *filename, int out_fd, size_t chunk, unsigned uring_depth, uint64_t start)
+{
+    if (uring_depth > 0)
+    {
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0)
+        {
+            fprintf(stderr, "Error: cannot open file \"%s\": %s\n", filename, strerror(errno));
+            return -1;
+        }
+        int rc = send_by_uring(fd, filename, out_fd, chunk, uring_depth);
+        close(fd);
+        if (rc != 1)
+            return rc;
+        /* 1 = io_uring not available here: use the classic loop below */
+    }
+
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "Error: cannot open file \"%s\": %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    if (start > 0 && fseeko(fp, (off_t)start, SEEK_SET) < 0)
+    {
+        fprintf(stderr, "Error: cannot seek in file \"%s\": %s\n", filename, strerror(errno));
+        fclose(fp);
+        return -1;
+    }
+
+    unsigned char *buf = malloc(chunk);
+    if (!buf)
+        die_perror("malloc");
+
+    /* Our chunks are already large; stdio's own buffer would just add a copy */
+    setvbuf(fp, NULL, _IONBF, 0);
+
+    printf("Process 1 starts sending data to Process 2 ...\n");
+
+    /* Stream the file into pipe1 in chunks */
+    struct pwc_stats *st = pwc_stats_active;
+    size_t nread;
+
+    while (1)
+    {
+        uint64_t t0 = st ? stats_clock() : 0;
+        nread = fread(buf, 1, chunk, fp);
+        if (st)
+            stats_stage_add(&st->read, t0, nread);
+        if (nread == 0)
+            break;
+        send_chunk(out_fd, buf, nread);
+    }
+
+    free(buf);
+
+    /* If fread stopped due to an error, handle it */
+    if (ferror(fp))
+    {
+        fprintf(stderr, "Error: failed while reading \"%s\".\n", filename);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * send_by_splice:
+ * Zero-copy transport: splice() moves page references from the file's page
+ * cache straight into pipe1, so the file bytes never land in a user buffer
+ * in Process 1. The parent only issues syscalls; its CPU time stays tiny.
+ *
+ * Some file systems (and special files) cannot be spliced. If the very first
+ * splice() says EINVAL we quietly fall back to a read()/write_all() loop.
+ * Like send_by_copy(), it starts at byte `start`.
+ */
+static int send_by_splice(const char *filename, int out_fd, size_t chunk, uint64_t start)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: cannot open file \"%s\": %s\n", filename, strerror(errno));
+        return -1;
+    }
+    if (start > 0 && lseek(fd, (off_t)start, SEEK_SET) < 0)
+    {
+        fprintf(stderr, "Error: cannot seek in file \"%s\": %s\n", filename, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    printf("Process 1 starts sending data to Process 2 ...\n");
+
+    /* With --stats a splice() counts as a file read: it is the whole transfer */
+    struct pwc_stats *st = pwc_stats_active;
+    int spliced_anything = 0;
+    while (1)
+    {
+        uint64_t t0 = st ? stats_clock() : 0;
+        ssize_t n = splice(fd, NULL, out_fd, NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (st && n >= 0)
+            stats_stage_add(&st->read, t0, (uint64_t)n);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                if (st)
+                    st->eintr++;
+                continue;
+            }
+            if (errno == EINVAL && !spliced_anything)
+                break; /* not spliceable: use the copy loop below */
+            fprintf(stderr, "Error: failed while splicing \"%s\": %s\n", filename, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        if (n == 0)
+        {
+            close(fd); /* EOF */
+            return 0;
+        }
+        spliced_anything = 1;
+    }
+
+    /* Fallback path: plain read() + write_all() from the same offset */
+    unsigned char *buf = malloc(chunk);
+    if (!buf)
+        die_perror("malloc");
+
+    int rc = 0;
+    while (1)
+    {
+        uint64_t t0 = st ? stats_clock() : 0;
+        ssize_t r = read(fd, buf, chunk);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error: failed while reading \"%s\".\n", filename);
+            rc = -1;
+            break;
+        }
+        if (st)
+            stats_stage_add(&st->read, t0, (uint64_t)r);
+        if (r == 0)
+            break;
+        send_chunk(out_fd, buf, (size_t)r);
+    }
+
+    free(buf);
+    close(fd);
+    return rc;
+}
+
+/*
+ * Pipe transports: the file travels through pipe1, either copied by Process 1
+ * (--transport=copy, the default) or spliced by the kernel (--transport=splice).
+ */
+static int run_pipe_mode(const struct options *opt)
+{
+    const char *filename = opt->filename;
 
     int pipe1[2]; /* parent -> child: file bytes */
-    int pipe2[2]; /* child -> parent: word count integer */
+    int pipe2[2]; /* child -> parent: word count result message */
 
     if (pipe(pipe1) == -1)
         die_perror("pipe(pipe1)");
     if (pipe(pipe2) == -1)
         die_perror("pipe(pipe2)");
 
+    /*
+     * A bigger pipe lets Process 1 run further ahead of Process 2 and means
+     * fewer wake-ups per megabyte. If the kernel refuses (e.g. above
+     * pipe-max-size without CAP_SYS_RESOURCE) we keep the default capacity.
+     */
+    if (opt->pipe_size > 0 && pipetune_set_capacity(pipe1[WRITE_END], opt->pipe_size) < 0)
+        fprintf(stderr, "Warning: cannot set pipe capacity to %zu bytes: %s\n", opt->pipe_size, strerror(errno));
+
     pid_t pid = fork();
     if (pid < 0)
         die_perror("fork");
@@ -124,69 +782,86 @@ int main(int argc, char *argv[])
 
         printf("Process 1 is reading file \"%s\" now ...\n", filename);
 
-        FILE *fp = fopen(filename, "r");
-        if (!fp)
-        {
-            /*
-             * IMPORTANT FIX:
-             * If we fail to open the file, we must shut down cleanly.
-             * We close the write-end of pipe1 so the child sees EOF and exits quietly.
-             * We also wait for the child so we don't leave a zombie process behind.
-             */
-            fprintf(stderr, "Error: cannot open file \"%s\": %s\n", filename, strerror(errno));
+        /* With a checkpoint only the bytes appended since the last run are sent */
+        uint64_t start = opt->checkpoint ? opt->checkpoint->offset : 0;
 
-            close(pipe1[WRITE_END]); /* child will get EOF immediately */
-            close(pipe2[READ_END]);  /* we won't receive anything */
+        /*
+         * Compressed input: Process 3 decompresses between us and Process 2
+         * (decompress.c). We send it the raw file through pipe #0, and only
+         * it keeps pipe #1 open, so Process 2 sees EOF when it is done.
+         */
+        int out_fd = pipe1[WRITE_END];
+        pid_t stage = -1;
+        if (opt->compression != COMPRESSION_NONE)
+        {
+            int pipe0[2]; /* Process 1 -> Process 3: compressed file bytes */
+            if (pipe(pipe0) == -1)
+                die_perror("pipe(pipe0)");
+            if (opt->pipe_size > 0)
+                pipetune_set_capacity(pipe0[WRITE_END], opt->pipe_size);
 
-            waitpid(pid, NULL, 0); /* clean up child process */
-            return EXIT_FAILURE;
+            stage = fork();
+            if (stage < 0)
+                die_perror("fork");
+            if (stage == 0)
+            {
+                /* =========================
+                 * Process 3 (Decompressor)
+                 * ========================= */
+                close(pipe0[WRITE_END]);
+                close(pipe2[READ_END]);
+                printf("Process 3 is decompressing %s data for Process 2 ...\n", compression_name(opt->compression));
+                int status = decompress_main(opt->compression, filename, pipe0[READ_END], pipe1[WRITE_END]);
+                close(pipe0[READ_END]);
+                close(pipe1[WRITE_END]);
+                return status;
+            }
+            close(pipe0[READ_END]);
+            close(pipe1[WRITE_END]);
+            out_fd = pipe0[WRITE_END];
         }
 
-        printf("Process 1 starts sending data to Process 2 ...\n");
-
-        /* Stream the file into pipe1 in chunks */
-        unsigned char buf[BUF_SIZE];
-        size_t nread;
+        if (pwc_perf_active)
+            perf_start(pwc_perf_active);
+        int rc;
+        if (opt->transport == TRANSPORT_SPLICE)
+            rc = send_by_splice(filename, out_fd, opt->chunk ? opt->chunk : SPLICE_CHUNK, start);
+        else
+            rc = send_by_copy(filename, out_fd, opt->chunk ? opt->chunk : BUF_SIZE, opt->uring_depth, start);
+        if (pwc_perf_active)
+            perf_stop(pwc_perf_active);
 
-        while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0)
+        /* Process 3 ends pipe #1 when it has written everything, or when the data is corrupt */
+        if (stage > 0)
         {
-            write_all(pipe1[WRITE_END], buf, nread);
+            close(out_fd);
+            out_fd = -1;
+            int status;
+            if (waitpid(stage, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                rc = -1;
         }
 
-        /* If fread stopped due to an error, handle it */
-        if (ferror(fp))
+        if (rc < 0)
         {
-            fprintf(stderr, "Error: failed while reading \"%s\".\n", filename);
-            fclose(fp);
-
-            close(pipe1[WRITE_END]);
-            close(pipe2[READ_END]);
+            /*
+             * IMPORTANT FIX:
+             * If we fail to open or read the file, we must shut down cleanly.
+             * We close the write-end of pipe1 so the child sees EOF and exits quietly.
+             * We also wait for the child so we don't leave a zombie process behind.
+             */
+            if (out_fd >= 0)
+                close(out_fd);      /* child will get EOF immediately */
+            close(pipe2[READ_END]); /* we won't receive anything */
 
-            waitpid(pid, NULL, 0);
+            waitpid(pid, NULL, 0); /* clean up child process */
             return EXIT_FAILURE;
         }
 
-        fclose(fp);
-
         /* Closing this signals EOF to the child (very important!) */
-        close(pipe1[WRITE_END]);
-
-        /* Receive the result (an int) from pipe2 */
-        int result = 0;
-        size_t got = read_all(pipe2[READ_END], &result, sizeof(result));
-        close(pipe2[READ_END]);
+        if (out_fd >= 0)
+            close(out_fd);
 
-        if (got != sizeof(result))
-        {
-            fprintf(stderr, "Error: did not receive wordcount result from Process 2.\n");
-            waitpid(pid, NULL, 0);
-            return EXIT_FAILURE;
-        }
-
-        waitpid(pid, NULL, 0);
-
-        printf("Process 1: The total number of words is %d.\n", result);
-        return EXIT_SUCCESS;
+        return finish_parent(opt, pid, pipe2[READ_END]);
     }
     else
     {
@@ -198,31 +873,70 @@ int main(int argc, char *argv[])
         close(pipe1[WRITE_END]);
         close(pipe2[READ_END]);
 
-        unsigned char buf[BUF_SIZE];
-        int total_words = 0;
-        int prev_in_word = 0;
+        size_t chunk = opt->chunk ? opt->chunk : BUF_SIZE;
+        unsigned char *buf = malloc(chunk);
+        if (!buf)
+            die_perror("malloc");
+
+        /*
+         * The stream counter (wordcount.h) takes care of words, lines and
+         * UTF-8 characters that were split between two reads. A resumed
+         * --checkpoint continues from the state saved by the last run.
+         */
+        struct wc_stream stream;
+        if (opt->checkpoint)
+            stream = opt->checkpoint->stream;
+        else
+            wc_stream_init(&stream, opt->metrics);
+
+        struct token_counter tokens;
+        token_counter_init(&tokens, opt);
 
         /*
          * Read from pipe1 until EOF.
          * EOF happens when parent closes pipe1[WRITE_END].
+         * A resumed checkpoint already has data, even if nothing was appended.
          */
-        int received_anything = 0;
+        int received_anything = opt->checkpoint && opt->checkpoint->offset > 0;
+        struct pwc_stats *st = pwc_stats_active;
+        if (st)
+            stats_begin(st); /* our own copy of Process 1's struct: start from zero */
+        uint64_t counted = 0;
+        struct perf_counters *pc = counter_perf_start();
         while (1)
         {
-            ssize_t r = read(pipe1[READ_END], buf, sizeof(buf));
+            uint64_t t0 = st ? stats_clock() : 0;
+            ssize_t r = read(pipe1[READ_END], buf, chunk);
             if (r < 0)
             {
                 if (errno == EINTR)
+                {
+                    if (st)
+                        st->eintr++;
                     continue;
+                }
                 die_perror("read(pipe1)");
             }
+            if (st)
+            {
+                stats_stage_add(&st->pipe, t0, (uint64_t)r);
+                if (r > 0 && (size_t)r < chunk)
+                    st->short_reads++;
+                t0 = stats_clock();
+            }
             if (r == 0)
                 break; /* EOF */
 
             received_anything = 1;
-            total_words += count_words_in_buffer(buf, (size_t)r, &prev_in_word);
+            wc_stream_feed(&stream, buf, (size_t)r);
+            token_counter_feed(&tokens, buf, (size_t)r);
+            counted += (uint64_t)r;
+            if (st)
+                stats_stage_add(&st->count, t0, (uint64_t)r);
         }
+        counter_perf_stop(pc, counted);
 
+        free(buf);
         close(pipe1[READ_END]);
 
         /*
@@ -241,10 +955,499 @@ int main(int argc, char *argv[])
         printf("Process 2 is counting words now ...\n");
         printf("Process 2 is sending the result back to Process 1 ...\n");
 
-        /* Send result back to parent */
-        write_all(pipe2[WRITE_END], &total_words, sizeof(total_words));
+        /* Send result back to parent (and the state before finishing, for --checkpoint) */
+        struct wc_stream state = stream;
+        struct wc_summary total = wc_stream_finish(&stream);
+        struct wc_result res = { .metrics = opt->metrics & WC_ALL };
+        wc_summary_counts(&total, &res.counts);
+        send_result(pipe2[WRITE_END], &res);
+        if (opt->checkpoint)
+            checkpoint_send_state(pipe2[WRITE_END], &state);
+        if (st)
+            stats_send(pipe2[WRITE_END], st);
+        if (pc)
+            perf_send(pipe2[WRITE_END], &pc->sample);
+        token_counter_send(&tokens, pipe2[WRITE_END]);
+        close(pipe2[WRITE_END]);
+
+        return EXIT_SUCCESS;
+    }
+}
+
+/*
+ * --mmap mode:
+ * The file is opened and mapped BEFORE fork(). A MAP_SHARED mapping is
+ * inherited by the child, so Process 2 scans exactly the same physical pages
+ * (the page cache) that the kernel already holds for the file. Nothing is
+ * copied user->kernel->user, and only the result crosses pipe2.
+ */
+static int run_mmap_mode(const struct options *opt)
+{
+    const char *filename = opt->filename;
+
+    printf("Process 1 is mapping file \"%s\" now ...\n", filename);
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        /* No child exists yet, so there is nothing else to clean up */
+        fprintf(stderr, "Error: cannot open file \"%s\": %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "Error: cannot stat file \"%s\": %s\n", filename, strerror(errno));
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    /* mmap() refuses a length of 0, so an empty file simply has no mapping */
+    size_t size = (size_t)st.st_size;
+    const unsigned char *map = NULL;
+
+    if (size > 0)
+    {
+        void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            fprintf(stderr, "Error: cannot map file \"%s\": %s\n", filename, strerror(errno));
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        /* We scan front to back once: ask the kernel for aggressive read-ahead */
+        madvise(p, size, MADV_SEQUENTIAL);
+        map = (const unsigned char *)p;
+    }
+
+    /* The mapping stays valid after close(); the child does not need the fd */
+    close(fd);
+
+    int pipe2[2]; /* child -> parent: word count result message */
+    if (pipe(pipe2) == -1)
+        die_perror("pipe(pipe2)");
+
+    printf("Process 1 shares the mapping with Process 2 ...\n");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        die_perror("fork");
+
+    if (pid > 0)
+    {
+        /* =========================
+         * Process 1 (Parent)
+         * ========================= */
+        close(pipe2[WRITE_END]);
+
+        int rc = finish_parent(opt, pid, pipe2[READ_END]);
+        if (map)
+            munmap((void *)map, size);
+        return rc;
+    }
+    else
+    {
+        /* =========================
+         * Process 2 (Child)
+         * ========================= */
+        close(pipe2[READ_END]);
+
+        printf("Process 2 is counting words now ...\n");
+
+        /*
+         * Walk the mapping in slices: each requested metric makes its own
+         * pass over a slice, and a slice small enough to stay in cache
+         * means the page cache is still only streamed from memory once.
+         */
+        struct wc_stream stream;
+        wc_stream_init(&stream, opt->metrics);
+
+        struct token_counter tokens;
+        token_counter_init(&tokens, opt);
+
+        struct pwc_stats *st = pwc_stats_active;
+        if (st)
+            stats_begin(st);
+        struct perf_counters *pc = counter_perf_start();
+
+        for (size_t off = 0; off < size; off += MMAP_SLICE)
+        {
+            size_t len = size - off < MMAP_SLICE ? size - off : MMAP_SLICE;
+            uint64_t t0 = st ? stats_clock() : 0;
+            wc_stream_feed(&stream, map + off, len);
+            token_counter_feed(&tokens, map + off, len);
+            if (st)
+                stats_stage_add(&st->count, t0, len);
+        }
+        counter_perf_stop(pc, size);
+
+        struct wc_summary total = wc_stream_finish(&stream);
+        struct wc_result res = { .metrics = opt->metrics & WC_ALL };
+        wc_summary_counts(&total, &res.counts);
+
+        printf("Process 2 is sending the result back to Process 1 ...\n");
+
+        send_result(pipe2[WRITE_END], &res);
+        if (st)
+            stats_send(pipe2[WRITE_END], st);
+        if (pc)
+            perf_send(pipe2[WRITE_END], &pc->sample);
+        token_counter_send(&tokens, pipe2[WRITE_END]);
         close(pipe2[WRITE_END]);
 
         return EXIT_SUCCESS;
     }
 }
+
+/*
+ * --transport=shm:
+ * Like the pipe transports, Process 1 reads the file and Process 2 counts
+ * it, but the chunks travel through a shared-memory ring instead of pipe1.
+ * Process 1 read()s directly into a free slot, so the only copy is the one
+ * from the page cache; Process 2 counts the slot in place and gives it back.
+ * pipe2 still carries the result, exactly as in the other modes.
+ */
+static int run_shm_mode(const struct options *opt)
+{
+    const char *filename = opt->filename;
+    size_t slot = opt->chunk ? opt->chunk : SHM_SLOT_SIZE;
+
+    struct shm_ring ring;
+    if (shm_ring_create(&ring, slot, opt->pipe_size ? opt->pipe_size : SHM_RING_SIZE) < 0)
+        die_perror("shm_ring_create");
+
+    int pipe2[2]; /* child -> parent: word count result message */
+    if (pipe(pipe2) == -1)
+        die_perror("pipe(pipe2)");
+
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid < 0)
+        die_perror("fork");
+
+    if (pid > 0)
+    {
+        /* =========================
+         * Process 1 (Parent)
+         * ========================= */
+        close(pipe2[WRITE_END]);
+        shm_ring_set_producer(&ring, pid);
+
+        printf("Process 1 is reading file \"%s\" now ...\n", filename);
+
+        int rc = 0;
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0)
+        {
+            fprintf(stderr, "Error: cannot open file \"%s\": %s\n", filename, strerror(errno));
+            rc = -1;
+        }
+        else
+        {
+            printf("Process 1 starts sending data to Process 2 ...\n");
+        }
+
+        struct pwc_stats *st = pwc_stats_active;
+        if (pwc_perf_active)
+            perf_start(pwc_perf_active);
+        while (fd >= 0)
+        {
+            /* With --stats waiting for a free slot is the "send" stage */
+            uint64_t t0 = st ? stats_clock() : 0;
+            unsigned char *dst = shm_ring_acquire(&ring);
+            if (st)
+                stats_stage_add(&st->write, t0, 0);
+            if (!dst)
+            {
+                fprintf(stderr, "Error: Process 2 exited before receiving all data.\n");
+                rc = -1;
+                break;
+            }
+
+            t0 = st ? stats_clock() : 0;
+            ssize_t r = read(fd, dst, slot);
+            if (st && r >= 0)
+                stats_stage_add(&st->read, t0, (uint64_t)r);
+            if (r < 0)
+            {
+                if (errno == EINTR)
+                {
+                    if (st)
+                        st->eintr++;
+                    continue;
+                }
+                fprintf(stderr, "Error: failed while reading \"%s\".\n", filename);
+                rc = -1;
+                break;
+            }
+            if (r == 0)
+                break; /* EOF: the empty slot is published by shm_ring_close() */
+
+            shm_ring_publish(&ring, (size_t)r);
+        }
+        if (pwc_perf_active)
+            perf_stop(pwc_perf_active);
+        if (fd >= 0)
+            close(fd);
+
+        /* The EOF slot tells Process 2 to stop, whether we succeeded or not */
+        shm_ring_close(&ring);
+
+        if (rc < 0)
+        {
+            /* Same clean shutdown as the pipe transports */
+            close(pipe2[READ_END]);
+            waitpid(pid, NULL, 0);
+            shm_ring_destroy(&ring);
+            return EXIT_FAILURE;
+        }
+
+        rc = finish_parent(opt, pid, pipe2[READ_END]);
+        shm_ring_destroy(&ring);
+        return rc;
+    }
+    else
+    {
+        /* =========================
+         * Process 2 (Child)
+         * ========================= */
+        close(pipe2[READ_END]);
+        shm_ring_set_consumer(&ring, parent);
+
+        struct wc_stream stream;
+        wc_stream_init(&stream, opt->metrics);
+
+        struct token_counter tokens;
+        token_counter_init(&tokens, opt);
+
+        struct pwc_stats *st = pwc_stats_active;
+        if (st)
+            stats_begin(st);
+        uint64_t counted = 0;
+        struct perf_counters *pc = counter_perf_start();
+
+        /* Count every slot in place until the EOF slot */
+        int received_anything = 0;
+        const unsigned char *data;
+        size_t len;
+        while (1)
+        {
+            uint64_t t0 = st ? stats_clock() : 0;
+            data = shm_ring_peek(&ring, &len);
+            if (st)
+                stats_stage_add(&st->pipe, t0, data ? len : 0);
+            if (!data)
+                break;
+
+            received_anything = 1;
+            t0 = st ? stats_clock() : 0;
+            wc_stream_feed(&stream, data, len);
+            token_counter_feed(&tokens, data, len);
+            counted += len;
+            if (st)
+                stats_stage_add(&st->count, t0, len);
+            shm_ring_release(&ring);
+        }
+        counter_perf_stop(pc, counted);
+        shm_ring_destroy(&ring);
+
+        /* Nothing arrived: Process 1 could not open the file, exit quietly */
+        if (!received_anything)
+        {
+            close(pipe2[WRITE_END]);
+            return EXIT_FAILURE;
+        }
+
+        printf("Process 2 finishes receiving data from Process 1 ...\n");
+        printf("Process 2 is counting words now ...\n");
+        printf("Process 2 is sending the result back to Process 1 ...\n");
+
+        struct wc_summary total = wc_stream_finish(&stream);
+        struct wc_result res = { .metrics = opt->metrics & WC_ALL };
+        wc_summary_counts(&total, &res.counts);
+        send_result(pipe2[WRITE_END], &res);
+        if (st)
+            stats_send(pipe2[WRITE_END], st);
+        if (pc)
+            perf_send(pipe2[WRITE_END], &pc->sample);
+        token_counter_send(&tokens, pipe2[WRITE_END]);
+        close(pipe2[WRITE_END]);
+
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    /* Make stdout unbuffered so prints from parent/child show up immediately */
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    struct options opt;
+    if (parse_args(argc, argv, &opt) < 0)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    /* The daemon counts whatever its clients send; it takes no file name */
+    if (opt.daemon_socket)
+        return run_daemon_mode(&opt);
+
+    /* If user didn't give a file name, print the required usage message */
+    if (!opt.filename)
+    {
+        printf("Please enter a file name.\n");
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    /*
+     * Several paths or a directory: the thread pool in multi.c counts them all.
+     * Decided first, so the cache and the daemon only ever see one regular file.
+     */
+    struct stat st;
+    if (opt.npaths > 1 || (stat(opt.filename, &st) == 0 && S_ISDIR(st.st_mode)))
+    {
+        if (opt.transport != TRANSPORT_COPY || opt.threads || opt.uring_depth || opt.freq || opt.distinct ||
+            opt.checkpoint_path || opt.follow || opt.stats || opt.perf)
+        {
+            fprintf(stderr, "Error: --transport, --threads, --uring, --freq, --distinct, --checkpoint, --follow, "
+                            "--stats and --perf apply to a single file.\n");
+            return EXIT_FAILURE;
+        }
+        if (opt.connect_socket)
+        {
+            fprintf(stderr, "Error: --connect counts one file with -l/-w/-c/-m/-L/--utf8 only.\n");
+            return EXIT_FAILURE;
+        }
+        int rc = run_multi_mode(&opt);
+        free(opt.paths);
+        return rc;
+    }
+
+    /*
+     * An unchanged file whose counts are cached needs no process at all.
+     * --freq and --distinct output is not cached, so those always count.
+     */
+    const char *cache_path = opt.cache_path ? opt.cache_path : getenv("PWORDCOUNT_CACHE");
+    struct result_cache cache;
+    if (cache_path && *cache_path && opt.npaths == 1 && !opt.freq && !opt.distinct && !opt.follow)
+    {
+        if (result_cache_open(&cache, cache_path) < 0)
+        {
+            fprintf(stderr, "Warning: cannot use cache file \"%s\": %s\n", cache_path, strerror(errno));
+        }
+        else
+        {
+            struct wc_counts counts;
+            if (result_cache_lookup(&cache, opt.filename, opt.metrics, &counts))
+            {
+                printf("Process 1 found file \"%s\" unchanged in the cache ...\n", opt.filename);
+                print_counts(opt.metrics & WC_ALL, &counts);
+                result_cache_close(&cache);
+                free(opt.paths);
+                return EXIT_SUCCESS;
+            }
+            opt.cache = &cache;
+        }
+    }
+
+    /* gzip/zstd input gets a decompression stage (Process 3), which only the pipe transports have */
+    if (opt.npaths == 1)
+        opt.compression = compression_detect(opt.filename);
+    if (opt.compression != COMPRESSION_NONE &&
+        (opt.transport == TRANSPORT_MMAP || opt.transport == TRANSPORT_SHM || opt.jobs > 1 || opt.threads ||
+         opt.checkpoint_path || opt.follow))
+    {
+        fprintf(stderr, "Error: \"%s\" is %s-compressed; it is counted through the copy or splice transport, "
+                        "without -j, --threads, --checkpoint or --follow.\n",
+                opt.filename, compression_name(opt.compression));
+        return EXIT_FAILURE;
+    }
+
+    /*
+     * Plain counts of one file can be served by a running daemon. With
+     * only PWORDCOUNT_SOCKET set, an unreachable daemon is not an error:
+     * existing scripts keep working and we simply count locally.
+     */
+    const char *socket_path = opt.connect_socket ? opt.connect_socket : getenv("PWORDCOUNT_SOCKET");
+    if (socket_path && *socket_path && opt.npaths == 1 && opt.jobs <= 1 && !opt.freq && !opt.distinct &&
+        !opt.threads && !opt.uring_depth && !opt.autotune && !opt.checkpoint_path && !opt.follow && !opt.stats &&
+        !opt.perf && opt.compression == COMPRESSION_NONE && opt.transport == TRANSPORT_COPY)
+    {
+        int rc = run_client_mode(&opt, socket_path);
+        if (rc >= 0)
+            return rc;
+        if (opt.connect_socket)
+        {
+            fprintf(stderr, "Error: cannot reach the daemon at \"%s\": %s\n", socket_path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    else if (opt.connect_socket)
+    {
+        fprintf(stderr, "Error: --connect counts one file with -l/-w/-c/-m/-L/--utf8 only.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* The probe measures pipes, so only the pipe transports use it */
+    if (opt.autotune && !opt.threads && (opt.transport == TRANSPORT_COPY || opt.transport == TRANSPORT_SPLICE))
+    {
+        /* Explicit --chunk / --pipe-size still win over the probe */
+        struct pipe_tuning best;
+        if (pipetune_auto(&best) == 0)
+        {
+            if (!opt.chunk)
+                opt.chunk = best.chunk;
+            if (!opt.pipe_size)
+                opt.pipe_size = best.pipe_size;
+            printf("Process 1 auto-tuned: chunk size %zu bytes, pipe capacity %zu bytes (%.0f MB/s probe)\n",
+                   opt.chunk, opt.pipe_size, best.mb_per_sec);
+        }
+        else
+        {
+            fprintf(stderr, "Warning: auto-tune probe failed, using defaults.\n");
+        }
+    }
+
+    struct checkpoint checkpoint;
+    if (opt.checkpoint_path)
+    {
+        int resumed = checkpoint_load(&checkpoint, opt.checkpoint_path, opt.filename, opt.metrics);
+        if (resumed < 0)
+        {
+            fprintf(stderr, "Error: cannot open file \"%s\": %s\n", opt.filename, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (resumed)
+            printf("Process 1 resumes file \"%s\" at byte %" PRIu64 " from checkpoint \"%s\" ...\n",
+                   opt.filename, checkpoint.offset, opt.checkpoint_path);
+        opt.checkpoint = &checkpoint;
+    }
+
+    /* Started here so the breakdown covers the whole run, fork() included */
+    struct pwc_stats stats;
+    if (opt.stats)
+        stats_begin(&stats);
+    struct perf_counters perf;
+    if (opt.perf)
+        perf_begin(&perf, 0);
+
+    if (opt.follow)
+        return run_follow_mode(&opt);
+
+    if (opt.jobs > 1)
+        return run_parallel_mode(&opt);
+
+    if (opt.threads)
+        return run_threads_mode(&opt);
+
+    if (opt.transport == TRANSPORT_MMAP)
+        return run_mmap_mode(&opt);
+
+    if (opt.transport == TRANSPORT_SHM)
+        return run_shm_mode(&opt);
+
+    return run_pipe_mode(&opt);
+}
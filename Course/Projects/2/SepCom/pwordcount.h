@@ -0,0 +1,128 @@
+#ifndef PWORDCOUNT_H
+#define PWORDCOUNT_H
+
+#include <stddef.h>
+
+struct result_cache;
+struct checkpoint;
+
+/*
+ * Shared definitions for the pwordcount run modes.
+ * pwordcount.c parses the command line and picks a mode;
+ * modes that need more than a page of code live in their own file.
+ */
+
+/* Default chunk size for fread()/read() on both sides of pipe1 */
+#define BUF_SIZE 4096
+
+/* Slot and ring size of the shared-memory ring (--transport=shm, --threads) */
+#define SHM_SLOT_SIZE (64 * 1024)
+#define SHM_RING_SIZE (1024 * 1024)
+
+/* Upper bound for --chunk, so a typo cannot ask malloc() for gigabytes */
+#define MAX_CHUNK (256 * 1024 * 1024)
+
+/* --follow: default --interval in milliseconds */
+#define FOLLOW_INTERVAL_MS 1000
+
+/* Upper bound for -j, one counting process per range */
+#define MAX_JOBS 1024
+
+/* How file bytes get from Process 1 to Process 2 */
+enum transport
+{
+    TRANSPORT_COPY,   /* fread() + write() through pipe1 (default) */
+    TRANSPORT_SPLICE, /* splice() file -> pipe1, no user-space copy in Process 1 */
+    TRANSPORT_MMAP,   /* shared mapping, pipe1 is not used at all */
+    TRANSPORT_SHM     /* shared-memory ring of slots instead of pipe1 (shmring.c) */
+};
+
+/* Compressed input, recognized by its magic number (decompress.c) */
+enum compression
+{
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+};
+
+/* Command-line settings, filled in by parse_args() */
+struct options
+{
+    const char *filename;     /* the first path */
+    const char **paths;       /* every file or directory named on the command line */
+    int npaths;
+    enum transport transport; /* --transport=copy|splice|mmap|shm (--mmap is a shorthand) */
+    size_t chunk;             /* --chunk=SIZE: bytes per read/write/splice call, 0 = default */
+    size_t pipe_size;         /* --pipe-size=SIZE: F_SETPIPE_SZ for pipe1, 0 = kernel default */
+    int autotune;             /* --autotune: probe the machine and pick chunk + pipe size */
+    const char *daemon_socket;  /* --daemon=SOCKET: serve counts on this Unix socket */
+    const char *connect_socket; /* --connect=SOCKET: ask that daemon instead of counting */
+    const char *cache_path;   /* --cache=FILE: result cache file (cache.h), NULL = no cache */
+    struct result_cache *cache; /* the opened cache; modes store their result in it, NULL = off */
+    const char *checkpoint_path; /* --checkpoint=FILE: resume append-only files (checkpoint.h) */
+    struct checkpoint *checkpoint; /* the loaded checkpoint, NULL = count from byte 0 */
+    int stats;                /* --stats: per-stage timing in both processes (stats.h) */
+    int perf;                 /* --perf: hardware counters around the hot loops (perf.h) */
+    enum compression compression; /* detected in main(); not NONE adds Process 3 to the pipe chain */
+    int follow;               /* --follow: keep counting what is appended to the file */
+    unsigned interval_ms;     /* --interval=SECONDS: how often --follow reports totals */
+    int threads;              /* --threads: reader + counter thread in one process, no fork() */
+    unsigned uring_depth;     /* --uring[=DEPTH]: io_uring reads in flight in Process 1, 0 = read() */
+    int jobs;                 /* -j N: number of counting processes, 0/1 = classic two-process mode */
+    unsigned metrics;         /* WC_* flags from -l -w -c -m -L (wordcount.h), default WC_WORDS */
+    int utf8;                 /* --utf8: Unicode whitespace rules (adds WC_UTF8 to metrics) */
+    int freq;                 /* --freq: also build a word frequency table in Process 2 */
+    size_t top;               /* --top=K: only send the K most frequent words, 0 = all */
+    unsigned distinct;        /* --distinct[=P]: HyperLogLog precision, 0 = off */
+};
+
+/*
+ * -j N mode (parallel.c):
+ * Process 1 splits the file into N byte ranges and forks N counters,
+ * each with its own result pipe, then merges their answers.
+ */
+int run_parallel_mode(const struct options *opt);
+
+/*
+ * --threads mode (threads.c):
+ * The same pipeline without fork() and pipes: a reader thread and a
+ * counter thread hand buffers over through the shared-memory ring.
+ */
+int run_threads_mode(const struct options *opt);
+
+/*
+ * Several paths and/or directories (multi.c):
+ * walk them, then count every regular file with a work-stealing thread
+ * pool and print one row per file plus a total.
+ */
+int run_multi_mode(const struct options *opt);
+
+/*
+ * --follow mode (follow.c):
+ * count the file, then keep sending what gets appended (inotify), follow
+ * truncation and rotation, and print updated totals every interval.
+ */
+int run_follow_mode(const struct options *opt);
+
+/*
+ * Compressed input (decompress.c):
+ * compression_detect() looks at the first bytes of the file. In the pipe
+ * transports Process 1 then sends the raw file to Process 3, which runs
+ * decompress_main(): compressed bytes from in_fd, plain bytes to out_fd
+ * (pipe1). Returns the exit status; corrupt input is reported there.
+ */
+enum compression compression_detect(const char *filename);
+const char *compression_name(enum compression compression);
+int decompress_main(enum compression compression, const char *name, int in_fd, int out_fd);
+
+/*
+ * Daemon mode (daemon.c):
+ * run_daemon_mode() serves counts on opt->daemon_socket with a prefork pool.
+ * run_client_mode() asks the daemon at socket_path to count opt->filename
+ * and prints the result; it returns -1 (errno set) if the daemon could not
+ * be reached, so the caller can count locally instead.
+ */
+int run_daemon_mode(const struct options *opt);
+int run_client_mode(const struct options *opt, const char *socket_path);
+
+#endif
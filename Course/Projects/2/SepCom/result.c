@@ -0,0 +1,65 @@
+#include "result.h"
+#include "ioutil.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+void send_result(int fd, const struct wc_result *res)
+{
+    struct wc_result msg = *res;
+    msg.magic = RESULT_MAGIC;
+    msg.version = RESULT_VERSION;
+    msg.length = (uint16_t)sizeof(msg);
+    msg.reserved = 0;
+
+    write_all(fd, &msg, sizeof(msg));
+}
+
+int recv_result(int fd, struct wc_result *res)
+{
+    memset(res, 0, sizeof(*res));
+
+    size_t got = read_all(fd, res, sizeof(*res));
+    if (got != sizeof(*res))
+        return -1;
+
+    if (res->magic != RESULT_MAGIC || res->version != RESULT_VERSION || res->length != sizeof(*res))
+        return -1;
+
+    return 0;
+}
+
+void print_counts(unsigned metrics, const struct wc_counts *c)
+{
+    if (metrics & WC_LINES)
+        printf("Process 1: The total number of lines is %" PRIu64 ".\n", c->lines);
+    if (metrics & WC_WORDS)
+        printf("Process 1: The total number of words is %" PRIu64 ".\n", c->words);
+    if (metrics & WC_CHARS)
+        printf("Process 1: The total number of characters is %" PRIu64 ".\n", c->chars);
+    if (metrics & WC_BYTES)
+        printf("Process 1: The total number of bytes is %" PRIu64 ".\n", c->bytes);
+    if (metrics & WC_MAX_LINE)
+        printf("Process 1: The longest line has %" PRIu64 " characters.\n", c->max_line);
+}
+
+void print_counts_row(unsigned metrics, const struct wc_counts *c, const char *name)
+{
+    char line[128];
+    size_t len = 0;
+
+    if (metrics & WC_LINES)
+        len += (size_t)snprintf(line + len, sizeof(line) - len, " %11" PRIu64, c->lines);
+    if (metrics & WC_WORDS)
+        len += (size_t)snprintf(line + len, sizeof(line) - len, " %11" PRIu64, c->words);
+    if (metrics & WC_CHARS)
+        len += (size_t)snprintf(line + len, sizeof(line) - len, " %11" PRIu64, c->chars);
+    if (metrics & WC_BYTES)
+        len += (size_t)snprintf(line + len, sizeof(line) - len, " %11" PRIu64, c->bytes);
+    if (metrics & WC_MAX_LINE)
+        len += (size_t)snprintf(line + len, sizeof(line) - len, " %11" PRIu64, c->max_line);
+
+    /* One printf() per row: stdout is unbuffered */
+    printf("%s %s\n", line, name);
+}
@@ -0,0 +1,58 @@
+#ifndef RESULT_H
+#define RESULT_H
+
+#include <stdint.h>
+
+#include "wordcount.h"
+
+/*
+ * The message Process 2 sends back over pipe #2.
+ *
+ * It used to be a bare int. Now it starts with a small header so the
+ * format can grow without the parent misreading an older or newer child:
+ *
+ *   magic    "PWCR", rejects garbage (e.g. a child that died mid-write)
+ *   version  RESULT_VERSION of the sender
+ *   length   total message size in bytes, header included
+ *
+ * All fields are in host byte order; both ends are the same binary.
+ *
+ * Version history:
+ *   1  64-bit word count
+ *   2  all wc metrics (struct wc_counts) plus the mask of requested ones
+ */
+#define RESULT_MAGIC 0x52435750u /* "PWCR" read as little-endian bytes */
+#define RESULT_VERSION 2
+
+struct wc_result
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t metrics;         /* WC_* flags that were counted */
+    uint32_t reserved;        /* keeps counts 8-byte aligned; always 0 */
+    struct wc_counts counts;  /* 64-bit: no overflow at 2^31 words */
+};
+
+/* Fill in the header and write the whole message to fd */
+void send_result(int fd, const struct wc_result *res);
+
+/*
+ * Read one message from fd and check its header.
+ * Returns 0 on success, -1 on EOF, short read or a header mismatch.
+ */
+int recv_result(int fd, struct wc_result *res);
+
+/*
+ * Print the requested metrics as "Process 1: ..." lines, in wc's order
+ * (lines, words, characters, bytes, longest line).
+ */
+void print_counts(unsigned metrics, const struct wc_counts *c);
+
+/*
+ * The same metrics as one wc-style row, "    lines    words ... name",
+ * for the per-file table of multi-file runs.
+ */
+void print_counts_row(unsigned metrics, const struct wc_counts *c, const char *name);
+
+#endif
@@ -0,0 +1,231 @@
+#define _GNU_SOURCE /* memfd_create() */
+
+#include "shmring.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+/* Spin this many times before sleeping: a chunk is often only a moment away */
+#define SPIN_LIMIT 256
+
+/* How often a sleeping side wakes up to check the other one is still alive */
+#define LIVENESS_NS (100 * 1000 * 1000)
+
+/*
+ * head and tail count slots since the start and are never reset; slot i
+ * lives at index i % slots (slots is a power of two, so wrap-around of the
+ * 32-bit counters is harmless). They sit on separate cache lines so the
+ * producer's stores do not keep stealing the consumer's line, and vice versa.
+ */
+struct shm_ring_shared
+{
+    _Atomic uint32_t head; /* slots published by the producer */
+    _Atomic uint32_t consumer_waiting;
+    char pad1[56];
+    _Atomic uint32_t tail; /* slots released by the consumer */
+    _Atomic uint32_t producer_waiting;
+    char pad2[56];
+    uint32_t len[];        /* bytes used in each slot */
+};
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static long futex(_Atomic uint32_t *addr, int op, uint32_t val, const struct timespec *timeout)
+{
+    /* No FUTEX_PRIVATE_FLAG: the word is shared between two processes */
+    return syscall(SYS_futex, (uint32_t *)addr, op, val, timeout, NULL, 0);
+}
+
+static int peer_alive(const struct shm_ring *r)
+{
+    if (r->peer == 0)
+        return 1; /* the other side is a thread of this process */
+    if (!r->producer)
+        return getppid() == r->peer; /* reparented = Process 1 is gone */
+
+    /* WNOWAIT: only look, the child is still reaped by waitpid() later */
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_PID, (id_t)r->peer, &info, WEXITED | WNOHANG | WNOWAIT) < 0)
+        return errno == EINTR;
+    return info.si_pid == 0;
+}
+
+/*
+ * Wait until *word is no longer `seen`. Returns 0, or -1 if the peer died.
+ *
+ * The waiting flag makes wake-ups cheap for the other side: it only calls
+ * FUTEX_WAKE when the flag is set. We set the flag BEFORE re-checking the
+ * word, and the other side changes the word BEFORE checking the flag, so
+ * (both being sequentially consistent) at least one of us sees the other.
+ * If the word changes just before FUTEX_WAIT, the kernel sees the new value
+ * and returns at once instead of sleeping.
+ */
+static int wait_for_change(const struct shm_ring *r, _Atomic uint32_t *word, uint32_t seen,
+                           _Atomic uint32_t *waiting)
+{
+    for (int i = 0; i < SPIN_LIMIT; i++)
+    {
+        if (atomic_load_explicit(word, memory_order_acquire) != seen)
+            return 0;
+        cpu_relax();
+    }
+
+    while (1)
+    {
+        atomic_store(waiting, 1);
+        if (atomic_load(word) != seen)
+        {
+            atomic_store(waiting, 0);
+            return 0;
+        }
+
+        struct timespec timeout = { 0, LIVENESS_NS };
+        if (futex(word, FUTEX_WAIT, seen, &timeout) < 0 && errno == ETIMEDOUT && !peer_alive(r))
+            return -1;
+    }
+}
+
+static void wake(_Atomic uint32_t *word, _Atomic uint32_t *waiting)
+{
+    if (atomic_exchange(waiting, 0))
+        futex(word, FUTEX_WAKE, 1, NULL);
+}
+
+int shm_ring_create(struct shm_ring *r, size_t slot_size, size_t ring_bytes)
+{
+    memset(r, 0, sizeof(*r));
+
+    uint32_t slots = 2;
+    while ((size_t)slots * 2 * slot_size <= ring_bytes && slots < (1u << 20))
+        slots *= 2;
+
+    /* Header (with the length array) first, slots page-aligned after it */
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t header = sizeof(struct shm_ring_shared) + slots * sizeof(uint32_t);
+    header = (header + page - 1) / page * page;
+    size_t total = header + (size_t)slots * slot_size;
+
+    int fd = memfd_create("pwordcount-ring", MFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, (off_t)total) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *p = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps the memory alive */
+    if (p == MAP_FAILED)
+        return -1;
+
+    r->shared = p;
+    r->data = (unsigned char *)p + header;
+    r->map_size = total;
+    r->slots = slots;
+    r->slot_size = (uint32_t)slot_size;
+    return 0;
+}
+
+void shm_ring_set_producer(struct shm_ring *r, pid_t consumer)
+{
+    r->producer = 1;
+    r->peer = consumer;
+}
+
+void shm_ring_set_consumer(struct shm_ring *r, pid_t producer)
+{
+    r->producer = 0;
+    r->peer = producer;
+}
+
+unsigned char *shm_ring_acquire(struct shm_ring *r)
+{
+    struct shm_ring_shared *s = r->shared;
+    uint32_t head = atomic_load_explicit(&s->head, memory_order_relaxed); /* only we write it */
+
+    while (1)
+    {
+        uint32_t tail = atomic_load_explicit(&s->tail, memory_order_acquire);
+        if (head - tail < r->slots)
+            break;
+        if (wait_for_change(r, &s->tail, tail, &s->producer_waiting) < 0)
+            return NULL;
+    }
+
+    return r->data + (size_t)(head & (r->slots - 1)) * r->slot_size;
+}
+
+void shm_ring_publish(struct shm_ring *r, size_t len)
+{
+    struct shm_ring_shared *s = r->shared;
+    uint32_t head = atomic_load_explicit(&s->head, memory_order_relaxed);
+
+    s->len[head & (r->slots - 1)] = (uint32_t)len;
+
+    /* seq_cst (not just release) so the waiting-flag check below is ordered after it */
+    atomic_store(&s->head, head + 1);
+    wake(&s->head, &s->consumer_waiting);
+}
+
+int shm_ring_close(struct shm_ring *r)
+{
+    if (!shm_ring_acquire(r))
+        return -1;
+    shm_ring_publish(r, 0);
+    return 0;
+}
+
+const unsigned char *shm_ring_peek(struct shm_ring *r, size_t *len)
+{
+    struct shm_ring_shared *s = r->shared;
+    uint32_t tail = atomic_load_explicit(&s->tail, memory_order_relaxed); /* only we write it */
+
+    while (1)
+    {
+        uint32_t head = atomic_load_explicit(&s->head, memory_order_acquire);
+        if (head != tail)
+            break;
+        if (wait_for_change(r, &s->head, head, &s->consumer_waiting) < 0)
+        {
+            *len = 0;
+            return NULL;
+        }
+    }
+
+    uint32_t index = tail & (r->slots - 1);
+    *len = s->len[index];
+    if (*len == 0)
+        return NULL; /* EOF marker */
+    return r->data + (size_t)index * r->slot_size;
+}
+
+void shm_ring_release(struct shm_ring *r)
+{
+    struct shm_ring_shared *s = r->shared;
+    uint32_t tail = atomic_load_explicit(&s->tail, memory_order_relaxed);
+
+    atomic_store(&s->tail, tail + 1);
+    wake(&s->tail, &s->producer_waiting);
+}
+
+void shm_ring_destroy(struct shm_ring *r)
+{
+    if (r->shared)
+        munmap(r->shared, r->map_size);
+    memset(r, 0, sizeof(*r));
+}
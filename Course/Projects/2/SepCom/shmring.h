@@ -0,0 +1,73 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Shared-memory ring for --transport=shm (shmring.c).
+ *
+ * A memfd mapped MAP_SHARED before fork() holds a single-producer /
+ * single-consumer ring of fixed-size slots:
+ *
+ *   Process 1 (producer)                     Process 2 (consumer)
+ *   slot = shm_ring_acquire()                data = shm_ring_peek(&len)
+ *   read(file, slot, slot_size)              count data[0..len)
+ *   shm_ring_publish(len)   -- head++ -->    shm_ring_release()  -- tail++ -->
+ *
+ * Handing a chunk over is one atomic store. A process only makes a
+ * syscall (a futex wait) when the ring is full or empty, and the other
+ * side only wakes it when it is really asleep.
+ *
+ * A zero-length slot marks EOF (shm_ring_close()). If the other process
+ * dies, the waiting side notices within a fraction of a second and gives
+ * up instead of sleeping forever.
+ */
+struct shm_ring_shared; /* the part inside the mapping, see shmring.c */
+
+struct shm_ring
+{
+    struct shm_ring_shared *shared;
+    unsigned char *data;   /* slots * slot_size bytes */
+    size_t map_size;
+    uint32_t slots;        /* power of two */
+    uint32_t slot_size;
+    int producer;          /* which side this process is */
+    pid_t peer;            /* the other process, for the liveness check (0 = a thread) */
+};
+
+/*
+ * Create the ring before fork(). ring_bytes is rounded to a power-of-two
+ * number of slots (at least 2). Returns 0, or -1 with errno set.
+ */
+int shm_ring_create(struct shm_ring *r, size_t slot_size, size_t ring_bytes);
+
+/*
+ * After fork(): tell each side which end it is and who the other one is.
+ * Two threads of one process can share a ring too: give each thread its
+ * own copy of the struct and pass 0 as the peer (no liveness check).
+ */
+void shm_ring_set_producer(struct shm_ring *r, pid_t consumer);
+void shm_ring_set_consumer(struct shm_ring *r, pid_t producer);
+
+/* Producer: next free slot (slot_size bytes), or NULL if the consumer died */
+unsigned char *shm_ring_acquire(struct shm_ring *r);
+
+/* Producer: hand the acquired slot over with len bytes in it */
+void shm_ring_publish(struct shm_ring *r, size_t len);
+
+/* Producer: no more data (publishes the empty EOF slot). -1 if the consumer died. */
+int shm_ring_close(struct shm_ring *r);
+
+/*
+ * Consumer: the oldest published slot and its length, or NULL at EOF
+ * (or if the producer died). The data stays valid until shm_ring_release().
+ */
+const unsigned char *shm_ring_peek(struct shm_ring *r, size_t *len);
+void shm_ring_release(struct shm_ring *r);
+
+/* Unmap (each process does this for itself) */
+void shm_ring_destroy(struct shm_ring *r);
+
+#endif
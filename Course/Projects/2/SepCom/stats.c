@@ -0,0 +1,58 @@
+#include "stats.h"
+#include "ioutil.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define STATS_MAGIC 0x53435750u /* "PWCS" read as little-endian bytes */
+
+struct pwc_stats *pwc_stats_active;
+
+void stats_begin(struct pwc_stats *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->start_ns = stats_clock();
+    pwc_stats_active = s;
+}
+
+void stats_send(int fd, struct pwc_stats *s)
+{
+    uint32_t magic = STATS_MAGIC;
+    s->wall_ns = stats_clock() - s->start_ns;
+    write_all(fd, &magic, sizeof(magic));
+    write_all(fd, s, sizeof(*s));
+}
+
+int stats_recv(int fd, struct pwc_stats *s)
+{
+    uint32_t magic;
+    if (read_all(fd, &magic, sizeof(magic)) != sizeof(magic) || magic != STATS_MAGIC)
+        return -1;
+    return read_all(fd, s, sizeof(*s)) == sizeof(*s) ? 0 : -1;
+}
+
+static void print_stage(const char *name, const struct stage_stats *s)
+{
+    if (s->calls == 0)
+    {
+        printf("Process 1 (stats): %-22s -\n", name);
+        return;
+    }
+    double ms = (double)s->ns / 1e6;
+    double mb = (double)s->bytes / 1e6;
+    printf("Process 1 (stats): %-22s %10.1f MB %10" PRIu64 " calls %10.2f ms %10.1f MB/s\n",
+           name, mb, s->calls, ms, ms > 0 ? mb / (ms / 1e3) : 0.0);
+}
+
+void stats_print(const struct pwc_stats *p1, const struct pwc_stats *p2)
+{
+    print_stage("P1 read (file)", &p1->read);
+    print_stage("P1 send (pipe #1/ring)", &p1->write);
+    print_stage("P2 receive", &p2->pipe);
+    print_stage("P2 count", &p2->count);
+    printf("Process 1 (stats): short writes %" PRIu64 ", short reads %" PRIu64 ", EINTR retries %" PRIu64 "\n",
+           p1->short_writes + p2->short_writes, p1->short_reads + p2->short_reads, p1->eintr + p2->eintr);
+    printf("Process 1 (stats): wall time Process 1 %.2f ms, Process 2 %.2f ms\n",
+           (double)p1->wall_ns / 1e6, (double)p2->wall_ns / 1e6);
+}
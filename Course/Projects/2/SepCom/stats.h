@@ -0,0 +1,69 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Per-stage instrumentation for --stats (stats.c).
+ *
+ * Each process fills in its own struct pwc_stats:
+ *   Process 1  read   file -> our buffer (fread/read/io_uring; splice: file -> pipe #1)
+ *              write  our buffer -> pipe #1 (write_all), or waiting for a free shm slot
+ *   Process 2  pipe   read(pipe #1), or waiting for a filled shm slot
+ *              count  wc_stream_feed() and the --freq/--distinct tokenizer
+ * plus short reads/writes and EINTR retries. Process 2 sends its copy
+ * on pipe #2 after the result, and Process 1 prints both side by side.
+ *
+ * When --stats is off pwc_stats_active is NULL: the hot loops only test
+ * a pointer, and ioutil.c looks at it only on its (rare) retry paths.
+ */
+struct stage_stats
+{
+    uint64_t ns;    /* time spent in the stage, CLOCK_MONOTONIC */
+    uint64_t bytes;
+    uint64_t calls;
+};
+
+struct pwc_stats
+{
+    uint64_t start_ns;     /* when this process started its part */
+    uint64_t wall_ns;      /* filled in when the process is done */
+    struct stage_stats read;
+    struct stage_stats write;
+    struct stage_stats pipe;
+    struct stage_stats count;
+    uint64_t short_reads;
+    uint64_t short_writes;
+    uint64_t eintr;
+};
+
+/* This process's statistics, or NULL when --stats is off */
+extern struct pwc_stats *pwc_stats_active;
+
+static inline uint64_t stats_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* One call of a stage that started at t0 and moved `bytes` */
+static inline void stats_stage_add(struct stage_stats *s, uint64_t t0, uint64_t bytes)
+{
+    s->ns += stats_clock() - t0;
+    s->bytes += bytes;
+    s->calls++;
+}
+
+/* Start counting in this process (resets everything) */
+void stats_begin(struct pwc_stats *s);
+
+/* pipe #2 wire format: header { magic "PWCS" } then the struct; -1 on a short or bad message */
+void stats_send(int fd, struct pwc_stats *s);
+int stats_recv(int fd, struct pwc_stats *s);
+
+/* The "Process 1 (stats): ..." breakdown of both processes */
+void stats_print(const struct pwc_stats *p1, const struct pwc_stats *p2);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * threads.c: the "--threads" mode of pwordcount
+ *
+ * The two-process design pays for its isolation: fork(), two pipes, and
+ * (with the pipe transports) a kernel copy of every byte. This mode keeps
+ * the same pipeline inside ONE process so both designs can be compared:
+ *
+ *   reader thread:  read(file) straight into a free ring slot, publish it
+ *   counter thread: count the slot in place, give it back
+ *
+ * The buffers are exchanged through the same lock-free SPSC ring as
+ * --transport=shm (shmring.h), so reading chunk k+1 overlaps counting
+ * chunk k and no byte is copied after read(). The main thread only starts
+ * both threads, waits for them and prints the answer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pwordcount.h"
+#include "wordcount.h"
+#include "ioutil.h"
+#include "result.h"
+#include "shmring.h"
+#include "tokens.h"
+#include "cache.h"
+
+struct reader_args
+{
+    struct shm_ring ring; /* this thread's view: the producer end */
+    int fd;
+    size_t slot;
+    int failed;
+};
+
+struct counter_args
+{
+    struct shm_ring ring; /* this thread's view: the consumer end */
+    const struct options *opt;
+    struct wc_summary total;
+    struct token_counter tokens;
+};
+
+static void *reader_main(void *p)
+{
+    struct reader_args *a = p;
+
+    while (1)
+    {
+        unsigned char *dst = shm_ring_acquire(&a->ring);
+        ssize_t r = read(a->fd, dst, a->slot);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            a->failed = errno;
+            break;
+        }
+        if (r == 0)
+            break;
+        shm_ring_publish(&a->ring, (size_t)r);
+    }
+
+    /* EOF slot, also after an error, so the counter thread always stops */
+    shm_ring_close(&a->ring);
+    return NULL;
+}
+
+static void *counter_main(void *p)
+{
+    struct counter_args *a = p;
+
+    struct wc_stream stream;
+    wc_stream_init(&stream, a->opt->metrics);
+    token_counter_init(&a->tokens, a->opt);
+
+    const unsigned char *data;
+    size_t len;
+    while ((data = shm_ring_peek(&a->ring, &len)) != NULL)
+    {
+        wc_stream_feed(&stream, data, len);
+        token_counter_feed(&a->tokens, data, len);
+        shm_ring_release(&a->ring);
+    }
+
+    a->total = wc_stream_finish(&stream);
+    return NULL;
+}
+
+static void start_thread(pthread_t *t, void *(*fn)(void *), void *arg)
+{
+    int rc = pthread_create(t, NULL, fn, arg);
+    if (rc != 0)
+    {
+        errno = rc;
+        die_perror("pthread_create");
+    }
+}
+
+int run_threads_mode(const struct options *opt)
+{
+    const char *filename = opt->filename;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: cannot open file \"%s\": %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    size_t slot = opt->chunk ? opt->chunk : SHM_SLOT_SIZE;
+    struct shm_ring ring;
+    if (shm_ring_create(&ring, slot, opt->pipe_size ? opt->pipe_size : SHM_RING_SIZE) < 0)
+        die_perror("shm_ring_create");
+
+    /* Each thread gets its own copy of the ring handle, as two processes would */
+    static struct reader_args reader;
+    static struct counter_args counter;
+    reader.ring = ring;
+    reader.fd = fd;
+    reader.slot = slot;
+    shm_ring_set_producer(&reader.ring, 0);
+    counter.ring = ring;
+    counter.opt = opt;
+    shm_ring_set_consumer(&counter.ring, 0);
+
+    printf("Process 1 starts a reader thread and a counter thread for file \"%s\" ...\n", filename);
+
+    pthread_t reader_thread, counter_thread;
+    start_thread(&counter_thread, counter_main, &counter);
+    start_thread(&reader_thread, reader_main, &reader);
+
+    pthread_join(reader_thread, NULL);
+    pthread_join(counter_thread, NULL);
+    close(fd);
+    shm_ring_destroy(&ring);
+
+    if (reader.failed)
+    {
+        fprintf(stderr, "Error: failed while reading \"%s\": %s\n", filename, strerror(reader.failed));
+        token_counter_finish(&counter.tokens);
+        return EXIT_FAILURE;
+    }
+
+    printf("Process 1 joined both threads ...\n");
+
+    struct wc_counts counts;
+    wc_summary_counts(&counter.total, &counts);
+    print_counts(opt->metrics & WC_ALL, &counts);
+    result_cache_store(opt->cache, &counts);
+    token_counter_print(&counter.tokens);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+#include "tokens.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void token_emit(void *ctx, const unsigned char *word, size_t len)
+{
+    struct token_counter *tc = ctx;
+    uint64_t hash = freq_hash(word, len);
+
+    if (tc->freq)
+        freq_add_count(&tc->table, word, len, hash, 1);
+    if (tc->distinct)
+        hll_add_hash(&tc->sketch, hash);
+}
+
+void token_counter_init(struct token_counter *tc, const struct options *opt)
+{
+    memset(tc, 0, sizeof(*tc));
+    tc->freq = opt->freq;
+    tc->top = opt->top;
+    tc->distinct = opt->distinct != 0;
+
+    if (tc->freq)
+        freq_init(&tc->table);
+    if (tc->distinct)
+        hll_init(&tc->sketch, opt->distinct); /* precision was checked by parse_args() */
+    if (tc->freq || tc->distinct)
+        wc_tokenizer_init(&tc->tok, token_emit, tc);
+}
+
+void token_counter_feed(struct token_counter *tc, const unsigned char *buf, size_t n)
+{
+    if (tc->freq || tc->distinct)
+        wc_tokenize(&tc->tok, buf, n);
+}
+
+void token_counter_finish(struct token_counter *tc)
+{
+    if (tc->freq || tc->distinct)
+        wc_tokenizer_finish(&tc->tok);
+}
+
+void token_counter_send(struct token_counter *tc, int fd)
+{
+    token_counter_finish(tc);
+
+    if (tc->distinct)
+    {
+        hll_send(fd, &tc->sketch);
+        hll_free(&tc->sketch);
+    }
+
+    if (tc->freq)
+    {
+        size_t n;
+        struct freq_entry *top = freq_top(&tc->table, tc->top, &n);
+        freq_send(fd, top, n, tc->table.used);
+
+        free(top);
+        freq_free(&tc->table);
+    }
+}
+
+void token_counter_print(struct token_counter *tc)
+{
+    token_counter_finish(tc);
+
+    if (tc->distinct)
+    {
+        hll_print(&tc->sketch);
+        hll_free(&tc->sketch);
+    }
+
+    if (tc->freq)
+    {
+        size_t n;
+        struct freq_entry *top = freq_top(&tc->table, tc->top, &n);
+        freq_print(top, n, tc->table.used);
+
+        free(top);
+        freq_free(&tc->table);
+    }
+}
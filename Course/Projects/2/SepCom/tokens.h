@@ -0,0 +1,41 @@
+#ifndef TOKENS_H
+#define TOKENS_H
+
+#include <stddef.h>
+
+#include "pwordcount.h"
+#include "wordcount.h"
+#include "freq.h"
+#include "hll.h"
+
+/*
+ * Per-word work for --freq and --distinct (tokens.c), shared by every run
+ * mode: one tokenizer feeding the frequency table and/or the HyperLogLog
+ * sketch. Every word is hashed once and the hash is used by both.
+ *
+ * All calls do nothing when both options are off, so counting loops can
+ * call them unconditionally.
+ */
+struct token_counter
+{
+    int freq;
+    size_t top;
+    struct freq_table table;
+    int distinct;
+    struct hll sketch;
+    struct wc_tokenizer tok;
+};
+
+void token_counter_init(struct token_counter *tc, const struct options *opt);
+void token_counter_feed(struct token_counter *tc, const unsigned char *buf, size_t n);
+
+/* Flush the word that runs up to end of input (safe to call more than once) */
+void token_counter_finish(struct token_counter *tc);
+
+/* Finish, then stream the sketch and the top K after the result message, and free */
+void token_counter_send(struct token_counter *tc, int fd);
+
+/* Finish, then print what token_counter_send() would have sent, and free */
+void token_counter_print(struct token_counter *tc);
+
+#endif
@@ -0,0 +1,350 @@
+#include "uring.h"
+#include "ioutil.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/* Buffer states */
+enum
+{
+    BUF_IDLE,     /* nothing queued */
+    BUF_IN_FLIGHT,
+    BUF_DONE      /* completed, result[] is valid */
+};
+
+/* ---------- raw syscalls (no liburing) ---------- */
+
+static int sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int ring_fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+/* ---------- ring setup ---------- */
+
+static int map_rings(struct uring_reader *u, const struct io_uring_params *p)
+{
+    u->sq_map_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    u->cq_map_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+
+    /* Newer kernels put both rings in one mapping */
+    if (p->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (u->cq_map_len > u->sq_map_len)
+            u->sq_map_len = u->cq_map_len;
+        u->cq_map_len = u->sq_map_len;
+    }
+
+    u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED)
+        return -1;
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        u->cq_map = u->sq_map;
+    }
+    else
+    {
+        u->cq_map = mmap(NULL, u->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         u->ring_fd, IORING_OFF_CQ_RING);
+        if (u->cq_map == MAP_FAILED)
+            return -1;
+    }
+
+    u->sqes_map_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   u->ring_fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+        return -1;
+
+    unsigned char *sq = u->sq_map;
+    u->sq_head = (unsigned *)(sq + p->sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p->sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p->sq_off.array);
+
+    unsigned char *cq = u->cq_map;
+    u->cq_head = (unsigned *)(cq + p->cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p->cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+    return 0;
+}
+
+int uring_reader_open(struct uring_reader *u, int fd, size_t chunk, unsigned depth)
+{
+    memset(u, 0, sizeof(*u));
+    u->ring_fd = -1;
+    u->fd = fd;
+    u->chunk = chunk;
+    u->depth = depth;
+    u->held = -1;
+    u->sq_map = u->cq_map = u->sqes = MAP_FAILED;
+
+    /* Offsets are only known up front for regular files */
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return -1;
+    if (!S_ISREG(st.st_mode))
+    {
+        errno = ESPIPE;
+        return -1;
+    }
+    u->size = st.st_size;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    u->ring_fd = sys_setup(depth, &p);
+    if (u->ring_fd < 0 || map_rings(u, &p) < 0)
+        goto fail;
+
+    /* One big page-aligned block, registered once as `depth` fixed buffers */
+    /* Up to 256 chunks of up to 256 MiB: failing here must fall back to read(), not exit */
+    int err = posix_memalign((void **)&u->buffers, 4096, (size_t)depth * chunk);
+    if (err != 0)
+    {
+        u->buffers = NULL;
+        errno = err; /* posix_memalign() returns the error instead of setting errno */
+        goto fail;
+    }
+    u->state = calloc(depth, sizeof(*u->state));
+    u->result = calloc(depth, sizeof(*u->result));
+    struct iovec *iov = calloc(depth, sizeof(*iov));
+    if (!u->state || !u->result || !iov)
+    {
+        free(iov);
+        errno = ENOMEM;
+        goto fail;
+    }
+
+    for (unsigned i = 0; i < depth; i++)
+    {
+        iov[i].iov_base = u->buffers + (size_t)i * chunk;
+        iov[i].iov_len = chunk;
+    }
+    int rc = sys_register(u->ring_fd, IORING_REGISTER_BUFFERS, iov, depth);
+    free(iov);
+    if (rc < 0)
+        goto fail;
+
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        uring_reader_close(u);
+        errno = saved;
+    }
+    return -1;
+}
+
+static void reap(struct uring_reader *u);
+
+/*
+ * Wait until no read is in flight. Ring teardown after close() is
+ * asynchronous, so a queued read could still land in u->buffers after
+ * free(); only its CQE tells us the kernel is done with the buffer.
+ */
+static int drain(struct uring_reader *u)
+{
+    while (1)
+    {
+        reap(u);
+        unsigned in_flight = 0;
+        for (unsigned i = 0; i < u->depth; i++)
+            in_flight += u->state[i] == BUF_IN_FLIGHT;
+        if (in_flight == 0)
+            return 0;
+
+        /* SQEs left unsubmitted by a failed submit_more() would never complete: submit them too */
+        unsigned pending = *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (sys_enter(u->ring_fd, pending, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            return -1;
+    }
+}
+
+void uring_reader_close(struct uring_reader *u)
+{
+    /* state[] exists only once the rings are mapped, so reap() can run */
+    int drained = 1;
+    if (u->ring_fd >= 0 && u->state)
+        drained = drain(u) == 0;
+
+    if (u->ring_fd >= 0)
+        close(u->ring_fd);
+    if (u->sqes != MAP_FAILED && u->sqes)
+        munmap(u->sqes, u->sqes_map_len);
+    if (u->cq_map != MAP_FAILED && u->cq_map && u->cq_map != u->sq_map)
+        munmap(u->cq_map, u->cq_map_len);
+    if (u->sq_map != MAP_FAILED && u->sq_map)
+        munmap(u->sq_map, u->sq_map_len);
+    /* If waiting failed the kernel may still write there: leak rather than free */
+    if (drained)
+        free(u->buffers);
+    free(u->state);
+    free(u->result);
+    memset(u, 0, sizeof(*u));
+    u->ring_fd = -1;
+}
+
+/* ---------- reading ---------- */
+
+static off_t chunk_offset(const struct uring_reader *u, uint64_t seq)
+{
+    return (off_t)(seq * u->chunk);
+}
+
+/* Queue reads for the following chunks into every idle buffer, then submit them */
+static int submit_more(struct uring_reader *u)
+{
+    unsigned queued = 0;
+    unsigned tail = *u->sq_tail;
+
+    while (u->submitted - u->handed_out < u->depth && chunk_offset(u, u->submitted) < u->size)
+    {
+        unsigned buf = (unsigned)(u->submitted % u->depth);
+        if (u->state[buf] != BUF_IDLE)
+            break;
+
+        off_t off = chunk_offset(u, u->submitted);
+        size_t len = u->chunk;
+        if ((off_t)len > u->size - off)
+            len = (size_t)(u->size - off);
+
+        unsigned index = tail & *u->sq_mask;
+        struct io_uring_sqe *sqe = &u->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->fd = u->fd;
+        sqe->addr = (uint64_t)(uintptr_t)(u->buffers + (size_t)buf * u->chunk);
+        sqe->len = (uint32_t)len;
+        sqe->off = (uint64_t)off;
+        sqe->buf_index = (uint16_t)buf;
+        sqe->user_data = buf;
+        u->sq_array[index] = index;
+
+        tail++;
+        queued++;
+        u->state[buf] = BUF_IN_FLIGHT;
+        u->submitted++;
+    }
+
+    if (queued == 0)
+        return 0;
+
+    /* The kernel must see the SQEs before it sees the new tail */
+    __atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+
+    while (queued > 0)
+    {
+        int n = sys_enter(u->ring_fd, queued, 0, 0);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        queued -= (unsigned)n;
+    }
+    return 0;
+}
+
+/* Move every available completion into state[] / result[] */
+static void reap(struct uring_reader *u)
+{
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail)
+    {
+        const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+        unsigned buf = (unsigned)cqe->user_data;
+        u->result[buf] = cqe->res;
+        u->state[buf] = BUF_DONE;
+        head++;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+}
+
+ssize_t uring_reader_next(struct uring_reader *u, const unsigned char **data)
+{
+    /* The caller is done with the previous chunk: reuse its buffer */
+    if (u->held >= 0)
+    {
+        u->state[u->held] = BUF_IDLE;
+        u->held = -1;
+    }
+
+    if (submit_more(u) < 0)
+        return -1;
+
+    if (u->handed_out == u->submitted)
+        return 0; /* everything up to the size seen at open() was read */
+    if (chunk_offset(u, u->handed_out) >= u->size)
+        return 0; /* the file shrank: the reads still in flight are past its end */
+
+    unsigned buf = (unsigned)(u->handed_out % u->depth);
+    while (u->state[buf] != BUF_DONE)
+    {
+        if (sys_enter(u->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            return -1;
+        reap(u);
+    }
+
+    off_t off = chunk_offset(u, u->handed_out);
+    size_t want = u->chunk;
+    if ((off_t)want > u->size - off)
+        want = (size_t)(u->size - off);
+
+    unsigned char *dst = u->buffers + (size_t)buf * u->chunk;
+    ssize_t got = u->result[buf];
+    if (got < 0)
+    {
+        errno = (int)-got;
+        return -1;
+    }
+
+    /*
+     * A short read is legal. Finish the chunk with pread() so every chunk
+     * covers its whole slot of the file and the order stays exact; a read
+     * that still comes up short means the file shrank, so stop after it.
+     */
+    while ((size_t)got < want)
+    {
+        ssize_t r = pread(u->fd, dst + got, want - (size_t)got, off + got);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (r == 0)
+        {
+            u->size = off + got;
+            break;
+        }
+        got += r;
+    }
+
+    u->handed_out++;
+    u->held = (int)buf;
+    *data = dst;
+    return got;
+}
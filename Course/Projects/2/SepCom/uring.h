@@ -0,0 +1,73 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * io_uring file reader for Process 1 (--uring, uring.c).
+ *
+ * The plain copy loop does one blocking read, then one blocking write, so
+ * with a cold cache the disk sits idle while we write to the pipe (and the
+ * pipe sits idle while we wait for the disk: queue depth 1).
+ *
+ * This reader keeps `depth` reads in flight at once, each into its own
+ * buffer registered with the kernel up front (IORING_OP_READ_FIXED, no
+ * per-read page pinning). Chunks are still handed out strictly in file
+ * order; while the caller writes one, the next ones are already loading.
+ *
+ * Talks to the kernel with the raw syscalls from <linux/io_uring.h>, so it
+ * needs no liburing. uring_reader_open() fails (and the caller falls back
+ * to read()) if the kernel or a seccomp policy does not allow io_uring.
+ */
+#define URING_DEFAULT_DEPTH 8
+#define URING_MAX_DEPTH 256
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+struct uring_reader
+{
+    int ring_fd;
+    int fd;
+
+    /* Submission queue (shared with the kernel) */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+
+    /* Completion queue (shared with the kernel) */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_map_len;
+
+    unsigned char *buffers; /* depth * chunk bytes, registered */
+    size_t chunk;
+    unsigned depth;
+
+    off_t size;            /* file size when opened */
+    uint64_t submitted;    /* chunks whose read has been queued */
+    uint64_t handed_out;   /* chunks returned to the caller */
+    int *state;            /* per buffer: see uring.c */
+    ssize_t *result;       /* per buffer: bytes read or -errno */
+    int held;              /* buffer the caller is using, or -1 */
+};
+
+/*
+ * Set up a reader for the regular file fd with `depth` buffers of `chunk`
+ * bytes. Returns 0, or -1 with errno set if io_uring cannot be used.
+ */
+int uring_reader_open(struct uring_reader *u, int fd, size_t chunk, unsigned depth);
+
+/*
+ * The next chunk in file order. Returns its length (0 at EOF) and sets *data;
+ * the data stays valid until the next call. Returns -1 with errno on a read error.
+ */
+ssize_t uring_reader_next(struct uring_reader *u, const unsigned char **data);
+
+/* Tear down the ring (fd itself is left open) */
+void uring_reader_close(struct uring_reader *u);
+
+#endif
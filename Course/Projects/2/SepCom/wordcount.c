@@ -1,5 +1,13 @@
 #include "wordcount.h"
 #include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WORDCOUNT_X86 1
+#endif
 
 /*
  * A "word" here is: a sequence of non-whitespace characters.
@@ -12,9 +20,9 @@
  *   if "friend" is split across two reads (e.g., "fr" + "iend"),
  *   we must NOT count it twice.
  */
-int count_words_in_buffer(const unsigned char *buf, size_t n, int *prev_in_word)
+static uint64_t count_words_scalar(const unsigned char *buf, size_t n, int *prev_in_word)
 {
-    int count = 0;
+    uint64_t count = 0;
 
     /* Start in whatever state the previous chunk ended in */
     int in_word = (*prev_in_word != 0);
@@ -42,3 +50,545 @@ int count_words_in_buffer(const unsigned char *buf, size_t n, int *prev_in_word)
     *prev_in_word = in_word;
     return count;
 }
+
+/*
+ * Helpers for the other wc metrics (lines, characters).
+ * A "character" is a UTF-8 code point: every byte except the continuation
+ * bytes 10xxxxxx starts one, so counting needs no decoder state.
+ */
+static uint64_t count_newlines_scalar(const unsigned char *buf, size_t n)
+{
+    uint64_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += (buf[i] == '\n');
+    return count;
+}
+
+static uint64_t count_chars_scalar(const unsigned char *buf, size_t n)
+{
+    uint64_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += ((buf[i] & 0xC0) != 0x80);
+    return count;
+}
+
+#ifdef WORDCOUNT_X86
+
+/*
+ * The SIMD kernels all work the same way, 64 bytes at a time:
+ *
+ *   1) classify every byte as whitespace or not, giving a 64-bit mask "ws"
+ *      (bit i set = byte i is whitespace). The C locale isspace() set is
+ *      ' ' plus the control range '\t'..'\r' (9..13), so two compares do it:
+ *      c == ' '  or  (unsigned)(c - 9) <= 4.
+ *
+ *   2) a word starts wherever a non-space byte follows a space byte:
+ *          starts = ~ws & ((ws << 1) | carry)
+ *      "carry" is 1 when the byte before this block was whitespace, which
+ *      is exactly !prev_in_word for the first block of a chunk.
+ *
+ *   3) count = popcount(starts); the next carry is the top bit of ws.
+ *
+ * No per-byte branches, so the speed no longer depends on the text.
+ * Whatever is left after the last full block goes through the scalar loop.
+ */
+static inline int count_block_starts(uint64_t ws, uint64_t *carry)
+{
+    uint64_t starts = ~ws & ((ws << 1) | *carry);
+    *carry = ws >> 63;
+    return __builtin_popcountll(starts);
+}
+
+/* Finish a chunk: hand the leftover bytes (< 64) to the scalar kernel */
+static inline uint64_t finish_tail(const unsigned char *buf, size_t n, size_t i,
+                                   uint64_t carry, uint64_t count, int *prev_in_word)
+{
+    int in_word = !carry;
+    count += count_words_scalar(buf + i, n - i, &in_word);
+    *prev_in_word = in_word;
+    return count;
+}
+
+/* SSE2: four 16-byte compares per 64-byte block (always available on x86-64) */
+__attribute__((target("sse2")))
+static uint32_t ws_mask_sse2(const unsigned char *p)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i is_space = _mm_cmpeq_epi8(v, space);
+    __m128i t = _mm_sub_epi8(v, tab);
+    __m128i is_ctl = _mm_cmpeq_epi8(_mm_min_epu8(t, four), t); /* t <= 4 unsigned */
+
+    return (uint32_t)_mm_movemask_epi8(_mm_or_si128(is_space, is_ctl));
+}
+
+__attribute__((target("sse2")))
+static uint64_t count_words_sse2(const unsigned char *buf, size_t n, int *prev_in_word)
+{
+    uint64_t carry = (*prev_in_word == 0);
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        uint64_t ws = (uint64_t)ws_mask_sse2(buf + i)
+                    | (uint64_t)ws_mask_sse2(buf + i + 16) << 16
+                    | (uint64_t)ws_mask_sse2(buf + i + 32) << 32
+                    | (uint64_t)ws_mask_sse2(buf + i + 48) << 48;
+        count += count_block_starts(ws, &carry);
+    }
+
+    return finish_tail(buf, n, i, carry, count, prev_in_word);
+}
+
+/* AVX2: two 32-byte compares per 64-byte block */
+__attribute__((target("avx2,popcnt")))
+static uint32_t ws_mask_avx2(const unsigned char *p)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4);
+
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i is_space = _mm256_cmpeq_epi8(v, space);
+    __m256i t = _mm256_sub_epi8(v, tab);
+    __m256i is_ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t);
+
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(is_space, is_ctl));
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t count_words_avx2(const unsigned char *buf, size_t n, int *prev_in_word)
+{
+    uint64_t carry = (*prev_in_word == 0);
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        uint64_t ws = (uint64_t)ws_mask_avx2(buf + i)
+                    | (uint64_t)ws_mask_avx2(buf + i + 32) << 32;
+        count += count_block_starts(ws, &carry);
+    }
+
+    return finish_tail(buf, n, i, carry, count, prev_in_word);
+}
+
+/* AVX-512BW: one 64-byte compare straight into a mask register */
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static uint64_t count_words_avx512bw(const unsigned char *buf, size_t n, int *prev_in_word)
+{
+    const __m512i space = _mm512_set1_epi8(' ');
+    const __m512i tab = _mm512_set1_epi8('\t');
+    const __m512i four = _mm512_set1_epi8(4);
+
+    uint64_t carry = (*prev_in_word == 0);
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(buf + i));
+        __mmask64 is_space = _mm512_cmpeq_epi8_mask(v, space);
+        __mmask64 is_ctl = _mm512_cmple_epu8_mask(_mm512_sub_epi8(v, tab), four);
+        count += count_block_starts((uint64_t)(is_space | is_ctl), &carry);
+    }
+
+    return finish_tail(buf, n, i, carry, count, prev_in_word);
+}
+
+/*
+ * Line and character counters: same 64-byte blocks, but the mask is just
+ * "byte == '\n'" or "byte is not a UTF-8 continuation byte". Continuation
+ * bytes 0x80..0xBF are exactly the signed bytes below -64.
+ */
+__attribute__((target("sse2")))
+static uint64_t count_newlines_sse2(const unsigned char *buf, size_t n)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        count += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+    }
+    return count + count_newlines_scalar(buf + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static uint64_t count_chars_sse2(const unsigned char *buf, size_t n)
+{
+    const __m128i limit = _mm_set1_epi8(-65);
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        count += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(v, limit)));
+    }
+    return count + count_chars_scalar(buf + i, n - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t count_newlines_avx2(const unsigned char *buf, size_t n)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        count += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+    }
+    return count + count_newlines_scalar(buf + i, n - i);
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t count_chars_avx2(const unsigned char *buf, size_t n)
+{
+    const __m256i limit = _mm256_set1_epi8(-65);
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        count += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, limit)));
+    }
+    return count + count_chars_scalar(buf + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static uint64_t count_newlines_avx512bw(const unsigned char *buf, size_t n)
+{
+    const __m512i nl = _mm512_set1_epi8('\n');
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(buf + i));
+        count += __builtin_popcountll(_mm512_cmpeq_epi8_mask(v, nl));
+    }
+    return count + count_newlines_scalar(buf + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static uint64_t count_chars_avx512bw(const unsigned char *buf, size_t n)
+{
+    const __m512i limit = _mm512_set1_epi8(-65);
+    uint64_t count = 0;
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(buf + i));
+        count += __builtin_popcountll(_mm512_cmpgt_epi8_mask(v, limit));
+    }
+    return count + count_chars_scalar(buf + i, n - i);
+}
+
+#endif /* WORDCOUNT_X86 */
+
+/* ---------- kernel table and runtime dispatch ---------- */
+
+typedef uint64_t (*count_fn)(const unsigned char *buf, size_t n, int *prev_in_word);
+typedef uint64_t (*tally_fn)(const unsigned char *buf, size_t n);
+
+struct kernel {
+    const char *name;
+    count_fn fn;
+    tally_fn newlines;
+    tally_fn chars;
+    int (*supported)(void);
+};
+
+static int always(void) { return 1; }
+
+#ifdef WORDCOUNT_X86
+static int has_sse2(void) { return __builtin_cpu_supports("sse2"); }
+static int has_avx2(void) { return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"); }
+static int has_avx512bw(void)
+{
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+        && __builtin_cpu_supports("popcnt");
+}
+#endif
+
+/* Ordered from slowest to fastest: "auto" picks the last supported one */
+static const struct kernel kernels[] = {
+    { "scalar", count_words_scalar, count_newlines_scalar, count_chars_scalar, always },
+#ifdef WORDCOUNT_X86
+    { "sse2", count_words_sse2, count_newlines_sse2, count_chars_sse2, has_sse2 },
+    { "avx2", count_words_avx2, count_newlines_avx2, count_chars_avx2, has_avx2 },
+    { "avx512bw", count_words_avx512bw, count_newlines_avx512bw, count_chars_avx512bw, has_avx512bw },
+#endif
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const struct kernel *active = &kernels[0];
+
+static void select_best(void)
+{
+#ifdef WORDCOUNT_X86
+    __builtin_cpu_init();
+#endif
+    for (size_t k = 0; k < NUM_KERNELS; k++) {
+        if (kernels[k].supported())
+            active = &kernels[k];
+    }
+}
+
+/*
+ * Pick the kernel once, before main() runs, so the hot path is a single
+ * indirect call and every process forked later inherits the choice.
+ */
+__attribute__((constructor))
+static void wordcount_init(void)
+{
+    select_best();
+}
+
+int wordcount_set_kernel(const char *name)
+{
+    if (strcmp(name, "auto") == 0) {
+        select_best();
+        return 0;
+    }
+
+    for (size_t k = 0; k < NUM_KERNELS; k++) {
+        if (strcmp(kernels[k].name, name) == 0) {
+            if (!kernels[k].supported())
+                return -1;
+            active = &kernels[k];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *wordcount_kernel_name(void)
+{
+    return active->name;
+}
+
+uint64_t count_words_in_buffer(const unsigned char *buf, size_t n, int *prev_in_word)
+{
+    return active->fn(buf, n, prev_in_word);
+}
+
+/* ---------- chunk summaries ---------- */
+
+/*
+ * Line structure for --max-line-length: one fused loop that measures every
+ * line in characters. It also yields the line and character totals, so
+ * those come for free. Newlines are rarer than other bytes, so the branch
+ * is well predicted; a memchr()-per-line walk was slower on short lines.
+ */
+static void summarize_lines(const unsigned char *buf, size_t n, struct wc_summary *s)
+{
+    uint64_t len = 0;      /* characters in the current line so far */
+    uint64_t longest = 0;
+    uint64_t lines = 0;
+    uint64_t chars = 0;    /* characters in finished lines, '\n' included */
+    uint64_t head = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = buf[i];
+        if (c == '\n') {
+            if (len > longest)
+                longest = len;
+            if (lines == 0)
+                head = len;
+            lines++;
+            chars += len + 1;
+            len = 0;
+        } else {
+            len += ((c & 0xC0) != 0x80);
+        }
+    }
+
+    /* Whatever follows the last '\n' is a partial line */
+    if (len > longest)
+        longest = len;
+    s->lines = lines;
+    s->chars = chars + len;
+    s->head_len = lines ? head : len;
+    s->tail_len = len;
+    s->max_line = longest;
+}
+
+struct wc_summary wc_summarize(const unsigned char *buf, size_t n, unsigned metrics)
+{
+    struct wc_summary s;
+    memset(&s, 0, sizeof(s));
+    s.bytes = n;
+    if (n == 0)
+        return s;
+
+    /*
+     * Each metric is its own tight loop over the (cache-hot) chunk, and
+     * metrics nobody asked for are skipped entirely. Word-only counting
+     * is therefore exactly the same single kernel call as before.
+     */
+    if (metrics & WC_WORDS) {
+        /* Starting "outside a word" makes a word at offset 0 count here */
+        int in_word = 0;
+        s.words = active->fn(buf, n, &in_word);
+        s.starts_in_word = !wc_is_space(buf[0]);
+        s.ends_in_word = in_word;
+    }
+
+    if (metrics & WC_MAX_LINE) {
+        summarize_lines(buf, n, &s);
+    } else {
+        if (metrics & WC_LINES)
+            s.lines = active->newlines(buf, n);
+        if (metrics & WC_CHARS)
+            s.chars = active->chars(buf, n);
+    }
+
+    return s;
+}
+
+static uint64_t max3(uint64_t a, uint64_t b, uint64_t c)
+{
+    uint64_t m = a > b ? a : b;
+    return m > c ? m : c;
+}
+
+struct wc_summary wc_combine(struct wc_summary left, struct wc_summary right)
+{
+    /* Empty chunks change nothing */
+    if (left.bytes == 0)
+        return right;
+    if (right.bytes == 0)
+        return left;
+
+    struct wc_summary s;
+    s.words = left.words + right.words;
+    if (left.ends_in_word && right.starts_in_word)
+        s.words--; /* one word split across the boundary */
+    s.bytes = left.bytes + right.bytes;
+    s.lines = left.lines + right.lines;
+    s.chars = left.chars + right.chars;
+    s.starts_in_word = left.starts_in_word;
+    s.ends_in_word = right.ends_in_word;
+
+    /* The line that spans the boundary is left's tail glued to right's head */
+    s.head_len = left.lines ? left.head_len : left.head_len + right.head_len;
+    s.tail_len = right.lines ? right.tail_len : left.tail_len + right.tail_len;
+    s.max_line = max3(left.max_line, right.max_line, left.tail_len + right.head_len);
+    return s;
+}
+
+void wc_summary_counts(const struct wc_summary *s, struct wc_counts *out)
+{
+    out->lines = s->lines;
+    out->words = s->words;
+    out->bytes = s->bytes;
+    out->chars = s->chars;
+    out->max_line = s->max_line;
+}
+
+/* ---------- streaming counter ---------- */
+
+void wc_stream_init(struct wc_stream *st, unsigned metrics)
+{
+    memset(st, 0, sizeof(*st));
+    st->metrics = metrics;
+}
+
+void wc_stream_feed(struct wc_stream *st, const unsigned char *buf, size_t n)
+{
+    if (!(st->metrics & WC_UTF8) || !(st->metrics & WC_WORDS)) {
+        st->total = wc_combine(st->total, wc_summarize(buf, n, st->metrics));
+        return;
+    }
+
+    /*
+     * UTF-8 words cannot be summarized per chunk (a chunk may end in the
+     * middle of a character), so they are counted by the stateful decoder
+     * and everything else still goes through the summaries.
+     */
+    st->total = wc_combine(st->total, wc_summarize(buf, n, st->metrics & ~WC_WORDS));
+    st->total.words += count_words_utf8(buf, n, &st->utf8);
+}
+
+struct wc_summary wc_stream_finish(struct wc_stream *st)
+{
+    if ((st->metrics & WC_UTF8) && (st->metrics & WC_WORDS)) {
+        st->total.words += count_words_utf8_finish(&st->utf8);
+        st->total.starts_in_word = st->utf8.first_in_word;
+        st->total.ends_in_word = st->utf8.in_word;
+    }
+    return st->total;
+}
+
+/* ---------- tokenizer ---------- */
+
+void wc_tokenizer_init(struct wc_tokenizer *tok, wc_emit_fn emit, void *ctx)
+{
+    memset(tok, 0, sizeof(*tok));
+    tok->emit = emit;
+    tok->ctx = ctx;
+}
+
+/* Append to the carry buffer, growing it geometrically (words are short) */
+static void carry_append(struct wc_tokenizer *tok, const unsigned char *p, size_t n)
+{
+    if (tok->carry_len + n > tok->carry_cap) {
+        size_t cap = tok->carry_cap ? tok->carry_cap : 64;
+        while (cap < tok->carry_len + n)
+            cap *= 2;
+        unsigned char *c = realloc(tok->carry, cap);
+        if (!c)
+            abort(); /* out of memory while holding one word */
+        tok->carry = c;
+        tok->carry_cap = cap;
+    }
+    memcpy(tok->carry + tok->carry_len, p, n);
+    tok->carry_len += n;
+}
+
+void wc_tokenize(struct wc_tokenizer *tok, const unsigned char *buf, size_t n)
+{
+    size_t i = 0;
+
+    /* Finish the word left over from the previous chunk first */
+    if (tok->carry_len > 0) {
+        size_t j = 0;
+        while (j < n && !wc_is_space(buf[j]))
+            j++;
+        carry_append(tok, buf, j);
+        if (j == n)
+            return; /* still not finished */
+        tok->emit(tok->ctx, tok->carry, tok->carry_len);
+        tok->carry_len = 0;
+        i = j;
+    }
+
+    while (i < n) {
+        while (i < n && wc_is_space(buf[i]))
+            i++;
+        size_t start = i;
+        while (i < n && !wc_is_space(buf[i]))
+            i++;
+        if (i == start)
+            break;
+        if (i == n) {
+            /* Runs into the next chunk: keep it for later */
+            carry_append(tok, buf + start, i - start);
+            break;
+        }
+        tok->emit(tok->ctx, buf + start, i - start);
+    }
+}
+
+void wc_tokenizer_finish(struct wc_tokenizer *tok)
+{
+    if (tok->carry_len > 0)
+        tok->emit(tok->ctx, tok->carry, tok->carry_len);
+    free(tok->carry);
+    tok->carry = NULL;
+    tok->carry_len = tok->carry_cap = 0;
+}
@@ -2,6 +2,7 @@
 #define WORDCOUNT_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /*
  * Count words in a chunk of bytes.
@@ -14,7 +15,186 @@
  *   - input:  0 if the previous chunk ended outside a word,
  *             1 if the previous chunk ended inside a word.
  *   - output: updated state after scanning this chunk.
+ *
+ * Counts are 64-bit: a file of short tokens passes 2^31 words at ~4 GB.
  */
-int count_words_in_buffer(const unsigned char *buf, size_t n, int *prev_in_word);
+uint64_t count_words_in_buffer(const unsigned char *buf, size_t n, int *prev_in_word);
+
+/*
+ * wc-style metrics. Pass any combination to wc_summarize(); metrics that
+ * are not requested are not computed (and read as 0).
+ *
+ *   WC_LINES     number of '\n' bytes
+ *   WC_WORDS     words, same definition as count_words_in_buffer()
+ *   WC_BYTES     bytes (always filled in; it costs nothing)
+ *   WC_CHARS     UTF-8 characters (bytes that are not 10xxxxxx)
+ *   WC_MAX_LINE  characters in the longest line, '\n' not included
+ */
+#define WC_LINES    0x01u
+#define WC_WORDS    0x02u
+#define WC_BYTES    0x04u
+#define WC_CHARS    0x08u
+#define WC_MAX_LINE 0x10u
+#define WC_ALL      0x1Fu
+
+/*
+ * Mode flag (not a metric): words are separated by Unicode whitespace
+ * (U+00A0, U+2003, U+3000, ...) instead of the C-locale isspace() set.
+ * Honoured by struct wc_stream; wc_summarize() itself ignores it.
+ */
+#define WC_UTF8     0x100u
+
+struct wc_counts {
+    uint64_t lines;
+    uint64_t words;
+    uint64_t bytes;
+    uint64_t chars;
+    uint64_t max_line;
+};
+
+/*
+ * Order-independent counting: chunk summaries.
+ *
+ * count_words_in_buffer() is sequential: chunk k needs chunk k-1's final
+ * prev_in_word. A summary instead describes a chunk on its own, so chunks
+ * can be counted in any order, by any thread or process, and merged later:
+ *
+ *   words           words that START inside the chunk, counting a word at
+ *                   offset 0 even if it might continue a previous chunk
+ *   bytes           chunk length (0 = empty chunk)
+ *   lines, chars    additive totals
+ *   max_line        longest line seen inside the chunk (partial lines too)
+ *   head_len        characters before the first '\n' (whole chunk if none)
+ *   tail_len        characters after the last '\n' (whole chunk if none)
+ *   starts_in_word  first byte is not whitespace
+ *   ends_in_word    last byte is not whitespace
+ *
+ * A chunk that is all whitespace has words == 0 and bytes > 0.
+ * A zeroed struct is the empty summary.
+ */
+struct wc_summary {
+    uint64_t words;
+    uint64_t bytes;
+    uint64_t lines;
+    uint64_t chars;
+    uint64_t max_line;
+    uint64_t head_len;
+    uint64_t tail_len;
+    int starts_in_word;
+    int ends_in_word;
+};
+
+/*
+ * Summarize one chunk in a single pass per requested metric (WC_* flags).
+ * Word counting uses the same kernel as count_words_in_buffer().
+ */
+struct wc_summary wc_summarize(const unsigned char *buf, size_t n, unsigned metrics);
+
+/*
+ * Merge two summaries of ADJACENT chunks, left one first.
+ * wc_combine() is associative and the empty summary is its identity, so
+ * summaries can be reduced pairwise in a tree; only the left-to-right
+ * order of the chunks must be kept. A word that straddles the two chunks
+ * (left ends inside a word, right starts inside one) is counted once, and
+ * a line that straddles them is measured as one line.
+ */
+struct wc_summary wc_combine(struct wc_summary left, struct wc_summary right);
+
+/* Final totals of a (fully combined) summary */
+void wc_summary_counts(const struct wc_summary *s, struct wc_counts *out);
+
+/*
+ * UTF-8 word counting (wordcount_utf8.c).
+ *
+ * Like count_words_in_buffer(), but input is decoded as UTF-8 and every
+ * Unicode White_Space character separates words. The state carries a
+ * partially decoded code point across calls, so chunks may be split
+ * anywhere, even in the middle of a multi-byte character. Pure-ASCII runs
+ * are handed to the SIMD kernel, so ASCII text is counted at full speed.
+ *
+ * Start with a zeroed state. After the last chunk, call
+ * count_words_utf8_finish() so a truncated final sequence is counted.
+ */
+struct wc_utf8_state {
+    unsigned state;       /* decoder state, 0 = between code points */
+    uint32_t code_point;  /* bits collected so far */
+    int in_word;          /* same meaning as prev_in_word */
+    int seen_any;         /* at least one character decoded */
+    int first_in_word;    /* first character was not whitespace */
+};
+
+uint64_t count_words_utf8(const unsigned char *buf, size_t n, struct wc_utf8_state *st);
+uint64_t count_words_utf8_finish(struct wc_utf8_state *st);
+
+/*
+ * Number of bytes to skip from buf so that it starts on a code point
+ * (at most 3 continuation bytes). Used to split a file into ranges that
+ * can be decoded independently.
+ */
+size_t wc_utf8_sync(const unsigned char *buf, size_t n);
+
+/*
+ * Byte-mode whitespace: exactly the C-locale isspace() set that every
+ * kernel above uses (' ', '\t', '\n', '\v', '\f', '\r').
+ */
+static inline int wc_is_space(unsigned char c)
+{
+    return c == ' ' || (unsigned char)(c - '\t') <= 4;
+}
+
+/*
+ * Streaming tokenizer: calls emit() once for every word, with the same
+ * boundaries as count_words_in_buffer(). A word split across two chunks
+ * is kept in a small carry buffer and emitted once it is complete, so the
+ * callback always sees whole words. Call wc_tokenizer_finish() after the
+ * last chunk to flush a word that runs up to end of input.
+ */
+typedef void (*wc_emit_fn)(void *ctx, const unsigned char *word, size_t len);
+
+struct wc_tokenizer {
+    wc_emit_fn emit;
+    void *ctx;
+    unsigned char *carry;  /* partial word from the previous chunk */
+    size_t carry_len;
+    size_t carry_cap;
+};
+
+void wc_tokenizer_init(struct wc_tokenizer *tok, wc_emit_fn emit, void *ctx);
+void wc_tokenize(struct wc_tokenizer *tok, const unsigned char *buf, size_t n);
+void wc_tokenizer_finish(struct wc_tokenizer *tok);
+
+/*
+ * Streaming counter: feed chunks in order, split anywhere, and get the
+ * summary of everything fed so far. This is what the counting processes
+ * use; it picks the byte kernels or the UTF-8 decoder from the WC_UTF8 flag.
+ */
+struct wc_stream {
+    unsigned metrics;
+    struct wc_summary total;
+    struct wc_utf8_state utf8;
+};
+
+void wc_stream_init(struct wc_stream *st, unsigned metrics);
+void wc_stream_feed(struct wc_stream *st, const unsigned char *buf, size_t n);
+struct wc_summary wc_stream_finish(struct wc_stream *st);
+
+/*
+ * Kernel selection.
+ *
+ * count_words_in_buffer() and wc_summarize() dispatch to one of several
+ * implementations:
+ *   "scalar"    portable byte-at-a-time loop (always available)
+ *   "sse2"      16 bytes per compare
+ *   "avx2"      32 bytes per compare
+ *   "avx512bw"  64 bytes per compare
+ * The fastest one the CPU supports is chosen automatically at startup.
+ *
+ * wordcount_set_kernel() overrides that choice ("auto" re-selects the best).
+ * Returns 0 on success, -1 if the name is unknown or the CPU lacks support.
+ */
+int wordcount_set_kernel(const char *name);
+
+/* Name of the kernel currently in use */
+const char *wordcount_kernel_name(void);
 
 #endif
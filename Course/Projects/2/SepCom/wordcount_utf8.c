@@ -0,0 +1,240 @@
+#include "wordcount.h"
+#include <string.h>
+
+/*
+ * UTF-8 aware word counting (--utf8).
+ *
+ * Same definition of a word as count_words_in_buffer(), except that
+ * "whitespace" is the Unicode White_Space set, so U+00A0 (no-break space),
+ * U+2003 (em space), U+3000 (ideographic space) etc. separate words too.
+ *
+ * Decoding is a small table-driven DFA. Its state (how many continuation
+ * bytes are still missing, and the bits collected so far) lives in
+ * struct wc_utf8_state, so a code point split between two reads is
+ * finished by the next call instead of being misread.
+ *
+ * Malformed input (stray continuation bytes, overlong forms, surrogates,
+ * values above U+10FFFF) decodes to U+FFFD, which is a word character, and
+ * decoding restarts at the offending byte - the usual "maximal subpart" rule.
+ */
+
+/* Byte classes: which role a byte can play in a UTF-8 sequence */
+enum {
+    C_ASCII,  /* 00..7F */
+    C_CONT1,  /* 80..8F continuation */
+    C_CONT2,  /* 90..9F continuation */
+    C_CONT3,  /* A0..BF continuation */
+    C_LEAD2,  /* C2..DF */
+    C_E0,     /* E0: next byte must be A0..BF (no overlongs) */
+    C_LEAD3,  /* E1..EC, EE..EF */
+    C_ED,     /* ED: next byte must be 80..9F (no surrogates) */
+    C_F0,     /* F0: next byte must be 90..BF (no overlongs) */
+    C_LEAD4,  /* F1..F3 */
+    C_F4,     /* F4: next byte must be 80..8F (max U+10FFFF) */
+    C_BAD,    /* C0, C1, F5..FF never appear in UTF-8 */
+    NUM_CLASSES
+};
+
+/* DFA states; S_ACCEPT means "between code points" */
+enum {
+    S_ACCEPT,
+    S_NEED1,  /* one more continuation byte */
+    S_NEED2,  /* two more */
+    S_NEED3,  /* three more */
+    S_E0,     /* after E0 */
+    S_ED,     /* after ED */
+    S_F0,     /* after F0 */
+    S_F4,     /* after F4 */
+    S_REJECT,
+    NUM_STATES
+};
+
+static unsigned char byte_class[256];
+static unsigned char transition[NUM_STATES][NUM_CLASSES];
+
+/* Payload bits kept from a lead byte, by class */
+static const unsigned char lead_mask[NUM_CLASSES] = {
+    [C_ASCII] = 0x7F, [C_LEAD2] = 0x1F, [C_E0] = 0x0F, [C_LEAD3] = 0x0F,
+    [C_ED] = 0x0F, [C_F0] = 0x07, [C_LEAD4] = 0x07, [C_F4] = 0x07,
+};
+
+/* Fill both tables once, before main() (same idea as the kernel dispatch) */
+__attribute__((constructor))
+static void utf8_tables_init(void)
+{
+    for (int b = 0; b < 256; b++) {
+        unsigned char c;
+        if (b < 0x80)       c = C_ASCII;
+        else if (b < 0x90)  c = C_CONT1;
+        else if (b < 0xA0)  c = C_CONT2;
+        else if (b < 0xC0)  c = C_CONT3;
+        else if (b < 0xC2)  c = C_BAD;
+        else if (b < 0xE0)  c = C_LEAD2;
+        else if (b == 0xE0) c = C_E0;
+        else if (b == 0xED) c = C_ED;
+        else if (b < 0xF0)  c = C_LEAD3;
+        else if (b == 0xF0) c = C_F0;
+        else if (b < 0xF4)  c = C_LEAD4;
+        else if (b == 0xF4) c = C_F4;
+        else                c = C_BAD;
+        byte_class[b] = c;
+    }
+
+    memset(transition, S_REJECT, sizeof(transition));
+
+    transition[S_ACCEPT][C_ASCII] = S_ACCEPT;
+    transition[S_ACCEPT][C_LEAD2] = S_NEED1;
+    transition[S_ACCEPT][C_E0] = S_E0;
+    transition[S_ACCEPT][C_LEAD3] = S_NEED2;
+    transition[S_ACCEPT][C_ED] = S_ED;
+    transition[S_ACCEPT][C_F0] = S_F0;
+    transition[S_ACCEPT][C_LEAD4] = S_NEED3;
+    transition[S_ACCEPT][C_F4] = S_F4;
+
+    for (int c = C_CONT1; c <= C_CONT3; c++) {
+        transition[S_NEED1][c] = S_ACCEPT;
+        transition[S_NEED2][c] = S_NEED1;
+        transition[S_NEED3][c] = S_NEED2;
+    }
+    transition[S_E0][C_CONT3] = S_NEED1;
+    transition[S_ED][C_CONT1] = S_NEED1;
+    transition[S_ED][C_CONT2] = S_NEED1;
+    transition[S_F0][C_CONT2] = S_NEED2;
+    transition[S_F0][C_CONT3] = S_NEED2;
+    transition[S_F4][C_CONT1] = S_NEED2;
+}
+
+/* Unicode White_Space property (PropList.txt) */
+static int is_unicode_space(uint32_t cp)
+{
+    if (cp < 0x80)
+        return cp == ' ' || (cp >= '\t' && cp <= '\r');
+
+    switch (cp) {
+    case 0x0085: case 0x00A0: case 0x1680:
+    case 0x2028: case 0x2029: case 0x202F: case 0x205F: case 0x3000:
+        return 1;
+    default:
+        return cp >= 0x2000 && cp <= 0x200A;
+    }
+}
+
+/* One finished code point: the same word-start rule as the byte kernels */
+static inline void feed_code_point(struct wc_utf8_state *st, uint32_t cp, uint64_t *count)
+{
+    int space = is_unicode_space(cp);
+
+    if (!st->seen_any) {
+        st->seen_any = 1;
+        st->first_in_word = !space;
+    }
+
+    if (space) {
+        st->in_word = 0;
+    } else if (!st->in_word) {
+        (*count)++;
+        st->in_word = 1;
+    }
+}
+
+/* Length of the pure-ASCII run at the start of buf, checked 8 bytes at a time */
+static size_t ascii_run(const unsigned char *buf, size_t n)
+{
+    size_t i = 0;
+
+    while (i + 8 <= n) {
+        uint64_t w;
+        memcpy(&w, buf + i, 8);
+        if (w & 0x8080808080808080ull)
+            break;
+        i += 8;
+    }
+    while (i < n && buf[i] < 0x80)
+        i++;
+    return i;
+}
+
+/* Runs shorter than this are cheaper to decode than to hand to the SIMD kernel */
+#define ASCII_FAST_MIN 64
+
+uint64_t count_words_utf8(const unsigned char *buf, size_t n, struct wc_utf8_state *st)
+{
+    uint64_t count = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        /*
+         * ASCII fast path: between code points, a run of ASCII bytes means
+         * exactly what it means to the byte kernels (Unicode adds no
+         * whitespace below U+0080), so let the SIMD kernel count it.
+         */
+        if (st->state == S_ACCEPT && buf[i] < 0x80) {
+            size_t run = ascii_run(buf + i, n - i);
+            if (run >= ASCII_FAST_MIN) {
+                if (!st->seen_any) {
+                    st->seen_any = 1;
+                    st->first_in_word = !is_unicode_space(buf[i]);
+                }
+                count += count_words_in_buffer(buf + i, run, &st->in_word);
+                i += run;
+                continue;
+            }
+
+            /* Too short for the kernel, but already scanned: each byte is a whole code point */
+            for (size_t end = i + run; i < end; i++)
+                feed_code_point(st, buf[i], &count);
+            continue;
+        }
+
+        unsigned char b = buf[i];
+        unsigned cls = byte_class[b];
+        unsigned next = transition[st->state][cls];
+
+        if (next == S_REJECT) {
+            /* Malformed: whatever we had (or this lone byte) becomes U+FFFD */
+            feed_code_point(st, 0xFFFD, &count);
+            if (st->state != S_ACCEPT) {
+                /* Retry this byte as the start of a new sequence */
+                st->state = S_ACCEPT;
+                st->code_point = 0;
+                continue;
+            }
+            i++;
+            continue;
+        }
+
+        if (st->state == S_ACCEPT)
+            st->code_point = b & lead_mask[cls];
+        else
+            st->code_point = (st->code_point << 6) | (b & 0x3F);
+
+        st->state = next;
+        if (next == S_ACCEPT)
+            feed_code_point(st, st->code_point, &count);
+        i++;
+    }
+
+    return count;
+}
+
+uint64_t count_words_utf8_finish(struct wc_utf8_state *st)
+{
+    uint64_t count = 0;
+
+    /* A truncated sequence at end of input is one malformed character */
+    if (st->state != S_ACCEPT) {
+        st->state = S_ACCEPT;
+        st->code_point = 0;
+        feed_code_point(st, 0xFFFD, &count);
+    }
+    return count;
+}
+
+size_t wc_utf8_sync(const unsigned char *buf, size_t n)
+{
+    /* Skip at most 3 continuation bytes: the tail of a code point */
+    size_t i = 0;
+    while (i < n && i < 3 && (buf[i] & 0xC0) == 0x80)
+        i++;
+    return i;
+}
@@ -0,0 +1,90 @@
+#include "wsdeque.h"
+#include "ioutil.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Memory orders follow "Correct and Efficient Work-Stealing for Weak Memory
+ * Models" (Le, Pop, Cohen, Nardelli, PPoPP 2013). The array slots are
+ * plain int64_t accessed through relaxed atomics.
+ */
+
+void wsdeque_init(struct wsdeque *d, size_t capacity)
+{
+    size_t cap = 1;
+    while (cap < capacity)
+        cap *= 2;
+
+    memset(d, 0, sizeof(*d));
+    d->tasks = calloc(cap, sizeof(*d->tasks));
+    if (!d->tasks)
+        die_perror("calloc");
+    d->mask = (int64_t)cap - 1;
+}
+
+void wsdeque_free(struct wsdeque *d)
+{
+    free(d->tasks);
+    d->tasks = NULL;
+}
+
+static inline void slot_store(struct wsdeque *d, int64_t i, int64_t task)
+{
+    __atomic_store_n(&d->tasks[i & d->mask], task, __ATOMIC_RELAXED);
+}
+
+static inline int64_t slot_load(struct wsdeque *d, int64_t i)
+{
+    return __atomic_load_n(&d->tasks[i & d->mask], __ATOMIC_RELAXED);
+}
+
+void wsdeque_push(struct wsdeque *d, int64_t task)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    slot_store(d, b, task);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+int64_t wsdeque_pop(struct wsdeque *d)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b)
+    {
+        /* Was already empty: undo */
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return WSDEQUE_EMPTY;
+    }
+
+    int64_t task = slot_load(d, b);
+    if (t == b)
+    {
+        /* Last element: a thief may be taking it right now, race on top */
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed))
+            task = WSDEQUE_EMPTY;
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+int64_t wsdeque_steal(struct wsdeque *d)
+{
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (t >= b)
+        return WSDEQUE_EMPTY;
+
+    int64_t task = slot_load(d, t);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+        return WSDEQUE_ABORT;
+    return task;
+}
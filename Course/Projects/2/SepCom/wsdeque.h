@@ -0,0 +1,42 @@
+#ifndef WSDEQUE_H
+#define WSDEQUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Chase-Lev work-stealing deque (wsdeque.c) of task numbers, used by the
+ * multi-file thread pool (multi.c).
+ *
+ * The owning thread pushes and pops at the BOTTOM, like a stack, with no
+ * atomic read-modify-write in the common case. Idle threads steal from the
+ * TOP with one compare-and-swap. Only the last element, which both ends
+ * may want, needs owner and thief to race for it on `top`.
+ *
+ * The capacity is fixed at creation: the pool knows all its tasks up
+ * front, so the circular array never has to grow.
+ */
+#define WSDEQUE_EMPTY (-1)
+#define WSDEQUE_ABORT (-2) /* lost a race with another thread: try again */
+
+struct wsdeque
+{
+    _Atomic int64_t top;
+    char pad[56]; /* thieves hammer top, the owner bottom: separate cache lines */
+    _Atomic int64_t bottom;
+    int64_t *tasks;
+    int64_t mask;
+};
+
+void wsdeque_init(struct wsdeque *d, size_t capacity);
+void wsdeque_free(struct wsdeque *d);
+
+/* Owner only */
+void wsdeque_push(struct wsdeque *d, int64_t task);
+int64_t wsdeque_pop(struct wsdeque *d);
+
+/* Any other thread: a task, WSDEQUE_EMPTY or WSDEQUE_ABORT */
+int64_t wsdeque_steal(struct wsdeque *d);
+
+#endif